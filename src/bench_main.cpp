@@ -0,0 +1,370 @@
+// Microbenchmarks for the scheduler and workflow hot paths. Each benchmark
+// builds a synthetic population at the requested scale (--workflows/--pdfs/
+// --subqueries), times only the operation under test, and reports ns/op and
+// heap allocations/op, so scheduler changes can be gated on isolated numbers
+// instead of noisy end-to-end makespans.
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "sim/cancellation.h"
+#include "sim/config.h"
+#include "sim/metrics.h"
+#include "sim/provider.h"
+#include "sim/scheduler.h"
+#include "sim/trace.h"
+#include "sim/worker.h"
+#include "sim/workflow.h"
+
+namespace fs = std::filesystem;
+
+// ---------------------------------------------------------------------------
+// Allocation counting: global operator new is instrumented so each benchmark
+// can report heap allocations per operation alongside time.
+// ---------------------------------------------------------------------------
+
+static std::atomic<std::uint64_t> g_alloc_count{0};
+
+void* operator new(std::size_t size) {
+  g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) { return ::operator new(size); }
+
+void* operator new(std::size_t size, std::align_val_t align) {
+  g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+  void* p = nullptr;
+  if (posix_memalign(&p, static_cast<std::size_t>(align), size ? size : 1) != 0) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void* operator new[](std::size_t size, std::align_val_t align) {
+  return ::operator new(size, align);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+// ---------------------------------------------------------------------------
+// Harness
+// ---------------------------------------------------------------------------
+
+struct BenchOptions {
+  int workflows = 64;
+  int pdfs = 10;
+  int subqueries = 4;
+  std::uint64_t seed = 1;
+};
+
+struct BenchResult {
+  std::uint64_t ops = 0;
+  std::uint64_t ns = 0;
+  std::uint64_t allocs = 0;
+};
+
+namespace {
+
+// Scoped timer + allocation counter around the hot region of a benchmark.
+class Measure {
+ public:
+  explicit Measure(BenchResult& res)
+      : res_(res), allocs_before_(g_alloc_count.load(std::memory_order_relaxed)),
+        start_(std::chrono::steady_clock::now()) {}
+  ~Measure() {
+    const auto end = std::chrono::steady_clock::now();
+    res_.ns += static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start_).count());
+    res_.allocs += g_alloc_count.load(std::memory_order_relaxed) - allocs_before_;
+  }
+
+ private:
+  BenchResult& res_;
+  std::uint64_t allocs_before_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+// Completes every runnable node for `rounds` breadth-first rounds, leaving
+// the frontier after the last round runnable. Two rounds past construction
+// put a workflow in its widest fan-out phase (per-pdf chunk nodes).
+void AdvanceRounds(sim::Workflow& wf, int rounds) {
+  for (int r = 0; r < rounds && !wf.done(); ++r) {
+    for (sim::NodeId nid : wf.RunnableNodes()) {
+      wf.MarkQueued(nid);
+      wf.MarkRunning(nid);
+      wf.MarkSucceeded(nid);
+    }
+  }
+}
+
+sim::WorkloadParams MakeParams(const BenchOptions& o, std::uint64_t seed_offset) {
+  sim::WorkloadParams params;
+  params.pdfs = o.pdfs;
+  params.subqueries_per_iter = o.subqueries;
+  params.seed = o.seed + seed_offset;
+  return params;
+}
+
+// Mirrors the controller's sharded workflow state, sized for a bench
+// population. Mutexes make the struct immovable, so shards live in-place.
+struct BenchShards {
+  static constexpr int kNumShards = 8;
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_map<sim::WorkflowId, sim::Workflow*> live;
+    std::unordered_map<sim::WorkflowId, double> workflow_cost;
+    std::unordered_map<sim::WorkflowId, double> workflow_start_ms;
+    std::unordered_map<std::uint64_t, sim::CancellationToken> cancel_tokens;
+  };
+
+  std::array<Shard, kNumShards> shards;
+  std::vector<std::unique_ptr<sim::Workflow>> owned;
+  std::vector<sim::ShardView> views;
+
+  BenchShards(const BenchOptions& o, const sim::ProviderConfig* provider_config, int rounds) {
+    for (int i = 0; i < o.workflows; ++i) {
+      const auto id = static_cast<sim::WorkflowId>(i + 1);
+      auto wf = std::make_unique<sim::Workflow>(id, MakeParams(o, static_cast<std::uint64_t>(i)),
+                                                provider_config);
+      AdvanceRounds(*wf, rounds);
+      Shard& shard = shards[id % kNumShards];
+      shard.live[id] = wf.get();
+      shard.workflow_cost[id] = 0.0;
+      shard.workflow_start_ms[id] = 0.0;
+      owned.push_back(std::move(wf));
+    }
+    views.reserve(kNumShards);
+    for (Shard& shard : shards) {
+      sim::ShardView view;
+      view.mutex = &shard.mutex;
+      view.workflows = &shard.live;
+      view.workflow_cost = &shard.workflow_cost;
+      view.workflow_start_ms = &shard.workflow_start_ms;
+      view.cancel_tokens = &shard.cancel_tokens;
+      views.push_back(view);
+    }
+  }
+};
+
+// One full Dispatch pass (score every runnable node across shards, select
+// options, enqueue in global order) over a population in its widest fan-out
+// phase. Covers RemainingCriticalPath, scoring, and top-K selection.
+BenchResult BenchDispatchTick(const BenchOptions& o) {
+  constexpr int kTicks = 20;
+  BenchResult res;
+  sim::ProviderConfig provider_config;
+  for (int t = 0; t < kTicks; ++t) {
+    // Fresh population per tick: Dispatch transitions nodes to Queued.
+    sim::ProviderManager provider_mgr(provider_config, 1.0);
+    sim::LatencyEstimateStore latency_store;
+    sim::LocalQueue local_queue;
+    sim::CancellationPool cancel_pool;
+    sim::SchedulerConfig sched_cfg;
+    sched_cfg.enable_model_routing = true;
+    sim::Scheduler scheduler(sched_cfg, &provider_mgr, &latency_store, &local_queue,
+                             &cancel_pool, nullptr);
+    BenchShards population(o, &provider_config, 2);
+    std::atomic<sim::AttemptId> next_attempt_id{1};
+    std::function<bool(sim::NodeId, sim::WorkflowId)> not_critical =
+        [](sim::NodeId, sim::WorkflowId) { return false; };
+    {
+      Measure m(res);
+      scheduler.Dispatch(population.views, 0.0, next_attempt_id, not_critical);
+    }
+    ++res.ops;
+  }
+  return res;
+}
+
+// Sorted snapshot of the maintained ready-set on a workflow in its widest
+// fan-out phase.
+BenchResult BenchRunnableNodes(const BenchOptions& o) {
+  constexpr std::uint64_t kIters = 100'000;
+  BenchResult res;
+  sim::ProviderConfig provider_config;
+  sim::Workflow wf(1, MakeParams(o, 0), &provider_config);
+  AdvanceRounds(wf, 2);
+  std::size_t sink = 0;
+  {
+    Measure m(res);
+    for (std::uint64_t i = 0; i < kIters; ++i) {
+      sink += wf.RunnableNodes().size();
+    }
+  }
+  if (sink == 0) throw std::runtime_error("runnable_nodes: empty frontier");
+  res.ops = kIters;
+  return res;
+}
+
+// Drives workflows from construction to done through the Queued -> Running
+// -> Succeeded state machine; an op is one completed node, so the number
+// includes graph expansion and incremental ready-set maintenance.
+BenchResult BenchWorkflowLifecycle(const BenchOptions& o) {
+  BenchResult res;
+  sim::ProviderConfig provider_config;
+  for (int i = 0; i < o.workflows; ++i) {
+    sim::Workflow wf(static_cast<sim::WorkflowId>(i + 1),
+                     MakeParams(o, static_cast<std::uint64_t>(i)), &provider_config);
+    Measure m(res);
+    while (!wf.done()) {
+      for (sim::NodeId nid : wf.RunnableNodes()) {
+        wf.MarkQueued(nid);
+        wf.MarkRunning(nid);
+        wf.MarkSucceeded(nid);
+        ++res.ops;
+      }
+    }
+  }
+  return res;
+}
+
+// Alternating Record / GetP50 on the dense striped store, cycling node types
+// and tiers the way a dispatch tick does.
+BenchResult BenchLatencyStore(const BenchOptions&) {
+  constexpr std::uint64_t kIters = 1'000'000;
+  BenchResult res;
+  sim::LatencyEstimateStore store;
+  constexpr std::array<sim::NodeType, 3> kTypes = {
+      sim::NodeType::Plan, sim::NodeType::Embed, sim::NodeType::ExtractEvidence};
+  double sink = 0.0;
+  {
+    Measure m(res);
+    for (std::uint64_t i = 0; i < kIters; ++i) {
+      const sim::NodeType type = kTypes[i % kTypes.size()];
+      const auto provider = static_cast<sim::ProviderId>(1 + i % 2);
+      const int tier = static_cast<int>(i % 3);
+      store.Record(type, provider, tier, 100.0 + static_cast<double>(i % 50));
+      sink += store.GetP50(type, provider, tier);
+    }
+  }
+  if (sink <= 0.0) throw std::runtime_error("latency_store: degenerate result");
+  res.ops = kIters * 2;  // one Record + one GetP50 per iteration
+  return res;
+}
+
+// Hot-path trace emission into the per-thread ring (the background flusher
+// drains concurrently, as in a real run).
+BenchResult BenchTraceEmit(const BenchOptions&) {
+  constexpr std::uint64_t kIters = 1 << 20;
+  BenchResult res;
+  const fs::path path = fs::temp_directory_path() / "sim_bench_trace.bin";
+  {
+    sim::TraceWriter writer(path.string());
+    Measure m(res);
+    for (std::uint64_t i = 0; i < kIters; ++i) {
+      writer.Emit(sim::TraceEvent::AttemptStart, static_cast<double>(i),
+                  static_cast<sim::WorkflowId>(i % 64), static_cast<sim::NodeId>(i % 128),
+                  "llm_provider_0");
+    }
+  }
+  std::error_code ec;
+  fs::remove(path, ec);
+  res.ops = kIters;
+  return res;
+}
+
+struct Benchmark {
+  const char* name;
+  BenchResult (*fn)(const BenchOptions&);
+};
+
+constexpr std::array<Benchmark, 5> kBenchmarks = {{
+    {"dispatch_tick", &BenchDispatchTick},
+    {"runnable_nodes", &BenchRunnableNodes},
+    {"workflow_lifecycle", &BenchWorkflowLifecycle},
+    {"latency_store", &BenchLatencyStore},
+    {"trace_emit", &BenchTraceEmit},
+}};
+
+void PrintUsage(std::ostream& os, const char* argv0) {
+  os << "Usage: " << argv0 << " [--workflows N] [--pdfs N] [--subqueries N] [--seed N]\n"
+     << "       [--filter SUBSTR] [--list]\n"
+     << "\n"
+     << "Runs the built-in microbenchmarks and reports ns/op and heap\n"
+     << "allocations/op per hot path. --filter runs only benchmarks whose\n"
+     << "name contains SUBSTR.\n";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  BenchOptions o;
+  std::string filter;
+  try {
+    for (int i = 1; i < argc; ++i) {
+      const std::string_view a = argv[i];
+      auto value = [&]() -> std::string {
+        if (i + 1 >= argc) throw std::runtime_error("Missing value for " + std::string(a));
+        return argv[++i];
+      };
+      if (a == "--workflows") {
+        o.workflows = std::stoi(value());
+      } else if (a == "--pdfs") {
+        o.pdfs = std::stoi(value());
+      } else if (a == "--subqueries") {
+        o.subqueries = std::stoi(value());
+      } else if (a == "--seed") {
+        o.seed = std::stoull(value());
+      } else if (a == "--filter") {
+        filter = value();
+      } else if (a == "--list") {
+        for (const Benchmark& b : kBenchmarks) std::cout << b.name << "\n";
+        return 0;
+      } else if (a == "-h" || a == "--help") {
+        PrintUsage(std::cout, argv[0]);
+        return 0;
+      } else {
+        throw std::runtime_error("Unknown argument: " + std::string(a));
+      }
+    }
+    if (o.workflows <= 0 || o.pdfs <= 0 || o.subqueries < 0) {
+      throw std::runtime_error("workflows and pdfs must be > 0, subqueries >= 0");
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "Error: " << e.what() << "\n\n";
+    PrintUsage(std::cerr, argv[0]);
+    return 2;
+  }
+
+  std::cout << "sim_bench: workflows=" << o.workflows << " pdfs=" << o.pdfs
+            << " subqueries=" << o.subqueries << " seed=" << o.seed << "\n\n";
+  std::cout << std::left << std::setw(22) << "benchmark" << std::right << std::setw(12) << "ops"
+            << std::setw(14) << "ns/op" << std::setw(14) << "allocs/op" << "\n";
+  for (const Benchmark& b : kBenchmarks) {
+    if (!filter.empty() && std::string_view(b.name).find(filter) == std::string_view::npos) {
+      continue;
+    }
+    const BenchResult res = b.fn(o);
+    const double ops = static_cast<double>(res.ops ? res.ops : 1);
+    std::cout << std::left << std::setw(22) << b.name << std::right << std::setw(12) << res.ops
+              << std::setw(14) << std::fixed << std::setprecision(1)
+              << static_cast<double>(res.ns) / ops << std::setw(14) << std::setprecision(3)
+              << static_cast<double>(res.allocs) / ops << "\n";
+  }
+  return 0;
+}
@@ -1,10 +1,15 @@
+#include <atomic>
 #include <cstdlib>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <mutex>
 #include <optional>
+#include <sstream>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -29,6 +34,11 @@ struct CliOptions {
   std::uint64_t seed = 1;
   int time_scale = 50;
   std::string out_dir = "out";
+  sim::EngineMode engine = sim::EngineMode::realtime;
+  sim::ArrivalMode arrival = sim::ArrivalMode::all_at_start;
+  double arrival_rate = 10.0;
+  double duration_s = -1.0;  // > 0: open-loop load generation for this window
+  double warmup_s = -1.0;    // warm-up to discard; < 0 = 10% of duration
 
   bool enable_model_routing = false;
   bool disable_hedging = false;
@@ -36,6 +46,15 @@ struct CliOptions {
   bool disable_dag_priority = false;
   double heavy_tail_prob = 0.02;
   double heavy_tail_multiplier = 50.0;
+
+  std::string sweep_file;  // non-empty: run every configuration in the file
+  int jobs = 0;            // sweep parallelism; 0 = hardware concurrency
+
+  double snapshot_at_ms = -1.0;  // DES: write out_dir/snapshot.bin at this virtual time
+  std::string resume_file;       // DES: restore state from a snapshot before running
+
+  bool record = false;           // persist sampled outcomes to out_dir/outcomes.bin
+  std::string replay_file;       // replay outcomes recorded by a previous run
 };
 
 static std::string ToString(Policy p) {
@@ -48,6 +67,34 @@ static std::string ToString(Policy p) {
   return "unknown";
 }
 
+static std::string ToString(sim::EngineMode e) {
+  switch (e) {
+    case sim::EngineMode::realtime: return "realtime";
+    case sim::EngineMode::des: return "des";
+  }
+  return "unknown";
+}
+
+static std::optional<sim::EngineMode> ParseEngine(std::string_view s) {
+  if (s == "realtime") return sim::EngineMode::realtime;
+  if (s == "des") return sim::EngineMode::des;
+  return std::nullopt;
+}
+
+static std::string ToString(sim::ArrivalMode a) {
+  switch (a) {
+    case sim::ArrivalMode::all_at_start: return "all_at_start";
+    case sim::ArrivalMode::poisson: return "poisson";
+  }
+  return "unknown";
+}
+
+static std::optional<sim::ArrivalMode> ParseArrival(std::string_view s) {
+  if (s == "all_at_start") return sim::ArrivalMode::all_at_start;
+  if (s == "poisson") return sim::ArrivalMode::poisson;
+  return std::nullopt;
+}
+
 static std::optional<Policy> ParsePolicy(std::string_view s) {
   if (s == "fifo_cheapest") return Policy::fifo_cheapest;
   if (s == "dag_cheapest") return Policy::dag_cheapest;
@@ -70,6 +117,14 @@ static void PrintUsage(std::ostream& os, const char* argv0) {
      << "  --seed N              RNG seed (default: 1)\n"
      << "  --time_scale N        Divide all sleeps by N (>=1) (default: 50)\n"
      << "  --out_dir PATH        Output directory (default: out)\n"
+     << "  --engine NAME         realtime (wall-clock sleeps) or des (virtual clock) (default: realtime)\n"
+     << "  --arrival NAME        all_at_start (closed-loop) or poisson (open-loop, lazy construction) (default: all_at_start)\n"
+     << "  --rate R              Poisson arrival rate, workflows per simulated second (default: 10)\n"
+     << "  --duration_s D        Open-loop load generation: inject arrivals for D simulated\n"
+     << "                        seconds (implies --arrival poisson, ignores --workflows) and\n"
+     << "                        report steady-state throughput and tier utilization\n"
+     << "  --warmup_s W          Discard workflows first dispatched in the initial W simulated\n"
+     << "                        seconds (default: 10% of duration)\n"
      << "\n"
      << "Flags:\n"
      << "  --enable_model_routing   Enable preference-list routing, escalation, and hedging\n"
@@ -78,6 +133,22 @@ static void PrintUsage(std::ostream& os, const char* argv0) {
      << "  --disable_dag_priority\n"
      << "  --heavy_tail_prob N    Fraction of tasks with heavy-tail latency (default: 0.02)\n"
      << "  --heavy_tail_mult N   Latency multiplier for heavy-tail tasks (default: 50)\n"
+     << "  --sweep FILE          Run every configuration in FILE (one flag list per line,\n"
+     << "                        '#' comments) concurrently in this process; lines without\n"
+     << "                        --out_dir write under <out_dir>/runN. Combined results go\n"
+     << "                        to <out_dir>/sweep_summary.csv\n"
+     << "  --jobs N              Concurrent sweep runs (default: hardware concurrency)\n"
+     << "  --snapshot_at_ms T    DES only: write <out_dir>/snapshot.bin at virtual time T\n"
+     << "  --resume FILE         DES only: restore simulator state from a snapshot, skipping\n"
+     << "                        the warm-up it captured (workload flags must match)\n"
+     << "  --record              Persist every sampled service time and failure outcome to\n"
+     << "                        <out_dir>/outcomes.bin\n"
+     << "  --replay FILE         Replay outcomes recorded by --record, so runs with different\n"
+     << "                        policies compare on the same workload realization\n"
+     << "\n"
+     << "Subcommands:\n"
+     << "  --convert DIR         Render DIR/trace.json and DIR/workflows.csv from the binary\n"
+     << "                        trace.bin/workflows.bin a run left in DIR, then exit\n"
      << "  -h, --help            Show this help\n";
 }
 
@@ -126,21 +197,20 @@ static void Validate(const CliOptions& o) {
   if (o.subqueries < 0) throw std::runtime_error("subqueries must be >= 0");
   require_pos(o.time_scale, "time_scale");
   if (o.out_dir.empty()) throw std::runtime_error("out_dir must be non-empty");
+  if (o.arrival == sim::ArrivalMode::poisson && o.arrival_rate <= 0.0) {
+    throw std::runtime_error("rate must be > 0");
+  }
+  if (o.duration_s > 0 && o.warmup_s >= o.duration_s) {
+    throw std::runtime_error("warmup_s must be shorter than duration_s");
+  }
 }
 
-static CliOptions ParseArgs(int argc, char** argv) {
-  std::vector<std::string> args;
-  args.reserve(static_cast<std::size_t>(argc));
-  for (int i = 0; i < argc; ++i) args.emplace_back(argv[i]);
-
-  CliOptions o;
-  for (std::size_t i = 1; i < args.size(); ++i) {
+// Applies flags from args[start..] onto o; shared between the command line
+// and sweep-file lines.
+static void ApplyOptions(CliOptions& o, const std::vector<std::string>& args,
+                         std::size_t start) {
+  for (std::size_t i = start; i < args.size(); ++i) {
     const std::string& a = args[i];
-    if (a == "-h" || a == "--help") {
-      PrintUsage(std::cout, argv[0]);
-      std::exit(0);
-    }
-
     if (a == "--enable_model_routing") {
       o.enable_model_routing = true;
       continue;
@@ -211,10 +281,86 @@ static CliOptions ParseArgs(int argc, char** argv) {
       ++i;
       continue;
     }
+    if (a == "--engine") {
+      auto e = ParseEngine(RequireValue(args, i));
+      if (!e) throw std::runtime_error("Unknown engine: " + RequireValue(args, i));
+      o.engine = *e;
+      ++i;
+      continue;
+    }
+    if (a == "--arrival") {
+      auto m = ParseArrival(RequireValue(args, i));
+      if (!m) throw std::runtime_error("Unknown arrival mode: " + RequireValue(args, i));
+      o.arrival = *m;
+      ++i;
+      continue;
+    }
+    if (a == "--rate") {
+      o.arrival_rate = std::stod(RequireValue(args, i));
+      ++i;
+      continue;
+    }
+    if (a == "--duration_s") {
+      o.duration_s = std::stod(RequireValue(args, i));
+      // Continuous injection only makes sense for the open-loop arrival
+      // process, so the flag implies it.
+      o.arrival = sim::ArrivalMode::poisson;
+      ++i;
+      continue;
+    }
+    if (a == "--warmup_s") {
+      o.warmup_s = std::stod(RequireValue(args, i));
+      ++i;
+      continue;
+    }
+    if (a == "--sweep") {
+      o.sweep_file = RequireValue(args, i);
+      ++i;
+      continue;
+    }
+    if (a == "--jobs") {
+      o.jobs = ParseInt(RequireValue(args, i), a);
+      ++i;
+      continue;
+    }
+    if (a == "--snapshot_at_ms") {
+      o.snapshot_at_ms = std::stod(RequireValue(args, i));
+      ++i;
+      continue;
+    }
+    if (a == "--resume") {
+      o.resume_file = RequireValue(args, i);
+      ++i;
+      continue;
+    }
+    if (a == "--record") {
+      o.record = true;
+      continue;
+    }
+    if (a == "--replay") {
+      o.replay_file = RequireValue(args, i);
+      ++i;
+      continue;
+    }
 
     throw std::runtime_error("Unknown argument: " + a);
   }
+}
+
+static CliOptions ParseArgs(int argc, char** argv) {
+  std::vector<std::string> args;
+  args.reserve(static_cast<std::size_t>(argc));
+  for (int i = 0; i < argc; ++i) args.emplace_back(argv[i]);
+
+  for (const std::string& a : args) {
+    if (a == "-h" || a == "--help") {
+      PrintUsage(std::cout, argv[0]);
+      std::exit(0);
+    }
+  }
 
+  CliOptions o;
+  ApplyOptions(o, args, 1);
   Validate(o);
   return o;
 }
@@ -229,6 +375,34 @@ static sim::SchedulerPolicy ToSchedulerPolicy(Policy p) {
   return sim::SchedulerPolicy::full;
 }
 
+static sim::ControllerConfig MakeControllerConfig(const CliOptions& o) {
+  sim::ControllerConfig cfg;
+  cfg.workflows = o.workflows;
+  cfg.pdfs = o.pdfs;
+  cfg.iters = o.iters;
+  cfg.subqueries = o.subqueries;
+  cfg.seed = o.seed;
+  cfg.time_scale = o.time_scale;
+  cfg.out_dir = o.out_dir;
+  cfg.policy = ToSchedulerPolicy(o.policy);
+  cfg.engine = o.engine;
+  cfg.arrival = o.arrival;
+  cfg.arrival_rate_per_s = o.arrival_rate;
+  cfg.enable_model_routing = o.enable_model_routing;
+  cfg.disable_hedging = o.disable_hedging;
+  cfg.disable_escalation = o.disable_escalation;
+  cfg.disable_dag_priority = o.disable_dag_priority;
+  cfg.heavy_tail_prob = o.heavy_tail_prob;
+  cfg.heavy_tail_multiplier = o.heavy_tail_multiplier;
+  cfg.snapshot_at_ms = o.snapshot_at_ms;
+  cfg.resume_file = o.resume_file;
+  cfg.record_outcomes = o.record;
+  cfg.replay_file = o.replay_file;
+  cfg.duration_s = o.duration_s;
+  cfg.warmup_s = o.warmup_s;
+  return cfg;
+}
+
 static int RunSimulation(const CliOptions& o) {
   std::error_code ec;
   fs::create_directories(o.out_dir, ec);
@@ -242,6 +416,8 @@ static int RunSimulation(const CliOptions& o) {
             << "  iters=" << o.iters << "\n"
             << "  subqueries=" << o.subqueries << "\n"
             << "  policy=" << ToString(o.policy) << "\n"
+            << "  engine=" << ToString(o.engine) << "\n"
+            << "  arrival=" << ToString(o.arrival) << "\n"
             << "  seed=" << o.seed << "\n"
             << "  time_scale=" << o.time_scale << "\n"
             << "  out_dir=" << o.out_dir << "\n"
@@ -250,22 +426,7 @@ static int RunSimulation(const CliOptions& o) {
             << "  disable_escalation=" << (o.disable_escalation ? "true" : "false") << "\n"
             << "  disable_dag_priority=" << (o.disable_dag_priority ? "true" : "false") << "\n";
 
-  sim::ControllerConfig cfg;
-  cfg.workflows = o.workflows;
-  cfg.pdfs = o.pdfs;
-  cfg.iters = o.iters;
-  cfg.subqueries = o.subqueries;
-  cfg.seed = o.seed;
-  cfg.time_scale = o.time_scale;
-  cfg.out_dir = o.out_dir;
-  cfg.policy = ToSchedulerPolicy(o.policy);
-  cfg.enable_model_routing = o.enable_model_routing;
-  cfg.disable_hedging = o.disable_hedging;
-  cfg.disable_escalation = o.disable_escalation;
-  cfg.disable_dag_priority = o.disable_dag_priority;
-  cfg.heavy_tail_prob = o.heavy_tail_prob;
-  cfg.heavy_tail_multiplier = o.heavy_tail_multiplier;
-
+  const sim::ControllerConfig cfg = MakeControllerConfig(o);
   sim::Controller controller(cfg);
   controller.Run();
 
@@ -274,15 +435,125 @@ static int RunSimulation(const CliOptions& o) {
             << "  makespan_mean_ms=" << summary.makespan_mean_ms << "\n"
             << "  makespan_p95_ms=" << summary.makespan_p95_ms << "\n"
             << "  cost_mean=" << summary.cost_mean << "\n"
-            << "  outputs: " << o.out_dir << "/workflows.csv, " << o.out_dir << "/tiers.csv, "
-            << o.out_dir << "/summary.csv, " << o.out_dir << "/trace.json\n";
+            << "  outputs: " << o.out_dir << "/workflows.bin, " << o.out_dir << "/tiers.csv, "
+            << o.out_dir << "/summary.csv, " << o.out_dir << "/trace.bin\n"
+            << "  (render CSV/JSON with: --convert " << o.out_dir << ")\n";
+
+  return 0;
+}
 
+// Runs every configuration in the sweep file inside this process, one
+// Controller per run on a small thread pool. Each run has its own RNG and
+// output directory, so results are bit-identical to single-run invocations;
+// only process startup is shared.
+static int RunSweep(const CliOptions& outer) {
+  std::ifstream in(outer.sweep_file);
+  if (!in) throw std::runtime_error("Failed to open sweep file: " + outer.sweep_file);
+
+  std::vector<CliOptions> runs;
+  std::string line;
+  while (std::getline(in, line)) {
+    const auto hash = line.find('#');
+    if (hash != std::string::npos) line.erase(hash);
+    std::istringstream tokens(line);
+    std::vector<std::string> args;
+    std::string tok;
+    while (tokens >> tok) args.push_back(tok);
+    if (args.empty()) continue;
+
+    CliOptions o;
+    // Runs without an explicit out_dir land under the outer out_dir.
+    o.out_dir = outer.out_dir + "/run" + std::to_string(runs.size());
+    ApplyOptions(o, args, 0);
+    if (!o.sweep_file.empty()) throw std::runtime_error("--sweep cannot nest");
+    Validate(o);
+    runs.push_back(std::move(o));
+  }
+  if (runs.empty()) throw std::runtime_error("Sweep file has no runs: " + outer.sweep_file);
+
+  const int jobs = outer.jobs > 0
+                       ? outer.jobs
+                       : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  std::cout << "agent_sched_sim sweep: " << runs.size() << " runs, " << jobs << " jobs\n";
+
+  std::vector<sim::SummaryMetrics> summaries(runs.size());
+  std::vector<std::string> errors(runs.size());
+  std::atomic<std::size_t> next{0};
+  std::mutex io_mutex;
+
+  auto worker = [&] {
+    for (std::size_t i = next.fetch_add(1); i < runs.size(); i = next.fetch_add(1)) {
+      const CliOptions& o = runs[i];
+      try {
+        std::error_code ec;
+        fs::create_directories(o.out_dir, ec);
+        if (ec) throw std::runtime_error("Failed to create out_dir: " + ec.message());
+        sim::Controller controller(MakeControllerConfig(o));
+        controller.Run();
+        summaries[i] = controller.summary_metrics();
+      } catch (const std::exception& e) {
+        errors[i] = e.what();
+      }
+      std::lock_guard lock(io_mutex);
+      if (errors[i].empty()) {
+        std::cout << "  run" << i << " (" << ToString(o.policy) << ", wf=" << o.workflows
+                  << ", seed=" << o.seed << "): makespan_p95_ms=" << summaries[i].makespan_p95_ms
+                  << "\n";
+      } else {
+        std::cerr << "  run" << i << " failed: " << errors[i] << "\n";
+      }
+    }
+  };
+  std::vector<std::thread> pool;
+  for (int t = 0; t < jobs; ++t) pool.emplace_back(worker);
+  for (std::thread& t : pool) t.join();
+
+  std::error_code ec;
+  fs::create_directories(outer.out_dir, ec);
+  const std::string combined = outer.out_dir + "/sweep_summary.csv";
+  std::ofstream csv(combined);
+  csv << "run,policy,engine,workflows,seed,time_scale,makespan_mean_ms,makespan_p50_ms,"
+         "makespan_p95_ms,makespan_p99_ms,cost_mean,cost_p50,error\n";
+  int failed = 0;
+  for (std::size_t i = 0; i < runs.size(); ++i) {
+    const CliOptions& o = runs[i];
+    const sim::SummaryMetrics& s = summaries[i];
+    csv << i << ',' << ToString(o.policy) << ',' << ToString(o.engine) << ',' << o.workflows
+        << ',' << o.seed << ',' << o.time_scale << ',' << s.makespan_mean_ms << ','
+        << s.makespan_p50_ms << ',' << s.makespan_p95_ms << ',' << s.makespan_p99_ms << ','
+        << s.cost_mean << ',' << s.cost_p50 << ',' << errors[i] << '\n';
+    if (!errors[i].empty()) ++failed;
+  }
+  std::cout << "sweep summary: " << combined << "\n";
+  return failed == 0 ? 0 : 1;
+}
+
+// Renders the human-readable outputs (trace.json, workflows.csv) from the
+// binary files a run left behind. Kept out of the run itself so simulation
+// time never includes text formatting.
+static int RunConvert(const std::string& dir) {
+  {
+    std::ofstream json(dir + "/trace.json");
+    if (!json) throw std::runtime_error("Failed to open " + dir + "/trace.json for writing");
+    sim::ConvertTraceToJson(dir + "/trace.bin", json);
+  }
+  {
+    std::ofstream csv(dir + "/workflows.csv");
+    if (!csv) throw std::runtime_error("Failed to open " + dir + "/workflows.csv for writing");
+    sim::ConvertWorkflowsToCsv(dir + "/workflows.bin", csv);
+  }
+  std::cout << "wrote " << dir << "/trace.json, " << dir << "/workflows.csv\n";
   return 0;
 }
 
 int main(int argc, char** argv) {
   try {
+    if (argc >= 2 && std::string_view(argv[1]) == "--convert") {
+      if (argc != 3) throw std::runtime_error("--convert takes exactly one directory");
+      return RunConvert(argv[2]);
+    }
     CliOptions o = ParseArgs(argc, argv);
+    if (!o.sweep_file.empty()) return RunSweep(o);
     return RunSimulation(o);
   } catch (const std::exception& e) {
     std::cerr << "Error: " << e.what() << "\n\n";
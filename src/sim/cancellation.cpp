@@ -0,0 +1,52 @@
+#include "sim/cancellation.h"
+
+namespace sim {
+
+bool CancellationToken::IsCancelled() const {
+  if (!slot_) return false;
+  if (slot_->generation.load(std::memory_order_acquire) != generation_) return true;
+  return slot_->cancelled.load(std::memory_order_acquire);
+}
+
+void CancellationToken::Cancel() const {
+  if (!slot_) return;
+  if (slot_->generation.load(std::memory_order_acquire) == generation_) {
+    slot_->cancelled.store(true, std::memory_order_release);
+  }
+}
+
+CancellationPool::CancellationPool(std::size_t initial_capacity) {
+  for (std::size_t i = 0; i < initial_capacity; ++i) {
+    slots_.emplace_back();
+    free_.push_back(&slots_.back());
+  }
+}
+
+CancellationToken CancellationPool::Acquire() {
+  std::lock_guard lock(mutex_);
+  CancellationToken::Slot* slot;
+  if (free_.empty()) {
+    slots_.emplace_back();
+    slot = &slots_.back();
+  } else {
+    slot = free_.back();
+    free_.pop_back();
+  }
+  slot->cancelled.store(false, std::memory_order_relaxed);
+  CancellationToken token;
+  token.slot_ = slot;
+  token.generation_ = slot->generation.load(std::memory_order_relaxed);
+  return token;
+}
+
+void CancellationPool::Release(const CancellationToken& token) {
+  if (!token.slot_) return;
+  std::lock_guard lock(mutex_);
+  // Bumping the generation invalidates every outstanding copy of the token,
+  // which is what cancels a hedge loser when the winner's result is processed.
+  if (token.slot_->generation.load(std::memory_order_relaxed) != token.generation_) return;
+  token.slot_->generation.fetch_add(1, std::memory_order_release);
+  free_.push_back(token.slot_);
+}
+
+}  // namespace sim
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace sim {
+
+class CancellationPool;
+
+// Handle to a pooled cancellation slot. Cheap to copy and safe to pass by
+// value into queued attempts; a default-constructed token never reads as
+// cancelled. The generation check means a token also reads as cancelled once
+// its slot has been released back to the pool, so an attempt that outlives
+// its node's resolution (a hedge loser, or work for a finished workflow)
+// observes cancellation even after the slot is recycled.
+class CancellationToken {
+ public:
+  bool IsCancelled() const;
+  void Cancel() const;
+  explicit operator bool() const { return slot_ != nullptr; }
+
+ private:
+  friend class CancellationPool;
+
+  struct Slot {
+    std::atomic<std::uint32_t> generation{0};
+    std::atomic<bool> cancelled{false};
+  };
+
+  Slot* slot_ = nullptr;
+  std::uint32_t generation_ = 0;
+};
+
+// Recycles cancellation slots instead of heap-allocating one atomic flag per
+// attempt. Slots live in a deque so recycled pointers stay stable; the pool
+// grows only when more tokens are outstanding than ever before. Release is
+// idempotent: a stale token whose slot was already recycled is ignored.
+class CancellationPool {
+ public:
+  explicit CancellationPool(std::size_t initial_capacity = 1024);
+
+  CancellationToken Acquire();
+  void Release(const CancellationToken& token);
+
+ private:
+  std::mutex mutex_;
+  std::deque<CancellationToken::Slot> slots_;
+  std::vector<CancellationToken::Slot*> free_;
+};
+
+}  // namespace sim
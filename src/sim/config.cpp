@@ -1,5 +1,7 @@
 #include "sim/config.h"
 
+#include <algorithm>
+
 namespace sim {
 
 LatencyConfig::LatencyConfig() {
@@ -117,6 +119,19 @@ ProviderConfig::ProviderConfig() {
   llm_fast.default_timeout_ms = 15'000;
   llm_fast.default_max_retries = 3;
   tiers.push_back(llm_fast);
+
+  // Intern provider names: id 0 is reserved for local execution, and every
+  // tier gets the id of its (possibly shared) provider name.
+  provider_names = {"local"};
+  for (TierConfig& tc : tiers) {
+    auto it = std::find(provider_names.begin(), provider_names.end(), tc.provider);
+    if (it == provider_names.end()) {
+      tc.provider_id = static_cast<ProviderId>(provider_names.size());
+      provider_names.push_back(tc.provider);
+    } else {
+      tc.provider_id = static_cast<ProviderId>(it - provider_names.begin());
+    }
+  }
 }
 
 }  // namespace sim
@@ -22,13 +22,18 @@ struct LatencyParams {
 
 // Per-tier configuration: token bucket, concurrency, pricing, failure rate.
 struct TierConfig {
-  std::string provider;
+  std::string provider;  // display name; hot paths carry the interned id below
+  ProviderId provider_id = kLocalProviderId;
   int tier_id = 0;
   double rate_per_sec = 10.0;      // token bucket refill rate
   double capacity = 100.0;         // token bucket capacity
   int concurrency_cap = 4;         // max in-flight attempts
   double price_per_call = 0.001;
   double p_fail = 0.02;            // Bernoulli transient failure probability
+  // Queue-depth cap: the scheduler stops routing to a tier whose backlog
+  // reaches this and leaves the node Runnable for a later tick, so overload
+  // shows up as queue growth in tiers.csv instead of unbounded RSS.
+  int max_queue_depth = 1024;
   int default_timeout_ms = 30'000;
   int default_max_retries = 3;
 };
@@ -46,7 +51,13 @@ struct ProviderConfig {
   std::vector<TierConfig> tiers;
   LatencyConfig latency;
 
+  // Interned provider names, indexed by ProviderId; [0] is "local". The
+  // constructor assigns each tier's provider_id from this table.
+  std::vector<std::string> provider_names;
+
   ProviderConfig();
+
+  const std::string& provider_name(ProviderId id) const { return provider_names[id]; }
 };
 
 }  // namespace sim
@@ -1,14 +1,20 @@
 #include "sim/controller.h"
 
+#include "sim/snapshot.h"
+
 #include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <fstream>
 #include <iostream>
-#include <numeric>
 #include <thread>
 
 namespace sim {
 
+// Virtual-ms cadence for rewriting summary.csv with cumulative percentiles
+// during the run (live progress for long experiments).
+static constexpr double kSummaryRewriteMs = 5000.0;
+
 Controller::Controller(const ControllerConfig& config)
     : config_(config),
       provider_config_(),
@@ -21,62 +27,139 @@ Controller::Controller(const ControllerConfig& config)
   sched_cfg.disable_escalation = config_.disable_escalation;
   sched_cfg.disable_dag_priority = config_.disable_dag_priority;
   sched_cfg.enable_model_routing = config_.enable_model_routing;
+  hedging_enabled_ = config_.enable_model_routing && !config_.disable_hedging &&
+                     config_.policy == SchedulerPolicy::full;
 
-  const ProviderConfig* wf_provider = config_.enable_model_routing ? &provider_config_ : nullptr;
-  for (int i = 0; i < config_.workflows; ++i) {
-    WorkloadParams wp;
-    wp.pdfs = config_.pdfs;
-    wp.subqueries_per_iter = config_.subqueries;
-    wp.max_iters = config_.iters;
-    wp.seed = config_.seed;
-    auto wf = std::make_unique<Workflow>(static_cast<WorkflowId>(i + 1), wp, wf_provider);
-    workflows_[wf->id()] = std::move(wf);
+  if (config_.engine != EngineMode::des &&
+      (config_.snapshot_at_ms >= 0 || !config_.resume_file.empty())) {
+    throw std::runtime_error("Snapshot/resume requires --engine des");
   }
 
-  trace_file_.open(config_.out_dir + "/trace.json");
-  trace_ = std::make_unique<TraceWriter>(trace_file_);
-
-  scheduler_ = std::make_unique<Scheduler>(
-      sched_cfg, provider_mgr_.get(), &latency_store_, &cpu_queue_, &io_queue_, trace_.get());
-
-  for (const auto& tier_ptr : provider_mgr_->tiers()) {
-    for (int t = 0; t < tier_ptr->concurrency_cap(); ++t) {
-      tier_workers_.emplace_back(TierWorkerLoop, tier_ptr.get(), sampler_.get(), rng_.get(),
-                                 &result_queue_, config_.time_scale, &shutdown_,
-                                 config_.heavy_tail_prob, config_.heavy_tail_multiplier);
+  open_loop_ = config_.duration_s > 0;
+  if (open_loop_) {
+    if (config_.arrival != ArrivalMode::poisson) {
+      throw std::runtime_error("duration_s requires --arrival poisson");
     }
+    duration_ms_ = config_.duration_s * 1000.0;
+    const double warmup_s =
+        config_.warmup_s >= 0 ? config_.warmup_s : 0.1 * config_.duration_s;
+    if (warmup_s >= config_.duration_s) {
+      throw std::runtime_error("warmup_s must be shorter than duration_s");
+    }
+    measure_start_ms_ = warmup_s * 1000.0;
+  }
+
+  if (config_.arrival == ArrivalMode::poisson) {
+    arrival_rng_ = std::make_unique<SeededRng>(config_.seed + 1);
+  } else if (config_.resume_file.empty()) {
+    // Closed-loop: everything arrives at t=0, constructed up front.
+    for (int i = 0; i < config_.workflows; ++i) SpawnWorkflow();
+  }
+  shard_views_.reserve(kNumShards);
+  for (WorkflowShard& shard : shards_) {
+    ShardView view;
+    view.mutex = &shard.mutex;
+    view.workflows = &shard.live;
+    view.workflow_cost = &shard.workflow_cost;
+    view.workflow_start_ms = &shard.workflow_start_ms;
+    view.cancel_tokens = &shard.cancel_tokens;
+    shard_views_.push_back(view);
   }
 
-  const int local_workers = 4;
-  for (int t = 0; t < local_workers; ++t) {
-    local_workers_.emplace_back(LocalWorkerLoop, &cpu_queue_, ResourceClass::cpu, sampler_.get(),
-                                rng_.get(), &result_queue_, provider_config_.latency,
-                                config_.time_scale, &shutdown_,
-                                config_.heavy_tail_prob, config_.heavy_tail_multiplier);
+  trace_ = std::make_unique<TraceWriter>(config_.out_dir + "/trace.bin");
+
+  workflows_bin_ = std::make_unique<MappedFile>(config_.out_dir + "/workflows.bin");
+  WorkflowFileHeader wf_header;
+  workflows_bin_->Append(&wf_header, sizeof(wf_header));
+
+  if (config_.record_outcomes) {
+    replay_log_ = std::make_unique<ReplayLog>(config_.out_dir + "/outcomes.bin");
   }
-  for (int t = 0; t < 2; ++t) {
-    local_workers_.emplace_back(LocalWorkerLoop, &io_queue_, ResourceClass::io, sampler_.get(),
-                                rng_.get(), &result_queue_, provider_config_.latency,
-                                config_.time_scale, &shutdown_,
-                                config_.heavy_tail_prob, config_.heavy_tail_multiplier);
+  if (!config_.replay_file.empty()) {
+    replay_source_ = std::make_unique<ReplaySource>(config_.replay_file);
   }
+
+  scheduler_ = std::make_unique<Scheduler>(
+      sched_cfg, provider_mgr_.get(), &latency_store_, &local_queue_, &cancel_pool_,
+      trace_.get(), &perf_);
+
+  if (config_.engine == EngineMode::des) {
+    // The discrete-event engine drives tiers and local queues from a virtual
+    // clock; no worker threads are spawned.
+    event_loop_ = std::make_unique<EventLoop>();
+    for (const auto& tier_ptr : provider_mgr_->tiers()) {
+      DesTierTokens tokens;
+      tokens.tokens = tier_ptr->config().capacity;
+      des_tier_tokens_[tier_ptr.get()] = tokens;
+    }
+    return;
+  }
+
+  // Timer-driven executor: in-flight attempts are deadline entries on one
+  // dispatcher thread, so tier concurrency caps cost heap bytes, not threads.
+  executor_ = std::make_unique<AttemptExecutor>(
+      provider_mgr_.get(), &local_queue_, sampler_.get(), rng_.get(),
+      provider_config_.latency, &result_queue_, config_.time_scale, config_.heavy_tail_prob,
+      config_.heavy_tail_multiplier, replay_log_.get(), replay_source_.get());
+  executor_->Start();
 }
 
 Controller::~Controller() {
   shutdown_.store(true);
   result_queue_.Shutdown();
-  cpu_queue_.Shutdown();
-  io_queue_.Shutdown();
+  local_queue_.Shutdown();
   if (scheduler_thread_.joinable()) scheduler_thread_.join();
   if (monitor_thread_.joinable()) monitor_thread_.join();
-  for (auto& t : tier_workers_) t.join();
-  for (auto& t : local_workers_) t.join();
-  for (auto& [k, v] : cancelled_flags_) delete v;
+  if (executor_) executor_->Shutdown();
 }
 
+Workflow* Controller::SpawnWorkflow() {
+  WorkloadParams wp;
+  wp.pdfs = config_.pdfs;
+  wp.subqueries_per_iter = config_.subqueries;
+  wp.max_iters = config_.iters;
+  wp.seed = config_.seed;
+  const ProviderConfig* wf_provider = config_.enable_model_routing ? &provider_config_ : nullptr;
+  auto wf = std::make_unique<Workflow>(next_workflow_id_++, wp, wf_provider);
+  Workflow* raw = wf.get();
+
+  WorkflowShard& shard = ShardFor(raw->id());
+  std::lock_guard lock(shard.mutex);
+  shard.live[raw->id()] = raw;
+  shard.workflow_start_ms[raw->id()] = kNeverDispatched;
+  shard.workflow_cost[raw->id()] = 0;
+  shard.workflow_counters[raw->id()] = {};
+  shard.owned[raw->id()] = std::move(wf);
+  ++workflows_spawned_;
+  return raw;
+}
+
+// Whether the arrival process should keep producing workflows: closed-loop
+// runs stop at the configured count, open-loop runs stop when the load
+// window closes.
+bool Controller::ArrivalsOpen() const {
+  if (open_loop_) return !duration_reached_;
+  return workflows_spawned_ < config_.workflows;
+}
+
+// Constructs every workflow whose Poisson arrival time has passed; returns
+// the number spawned. Interarrival draws use virtual ms so the arrival
+// process is identical across engines and time scales.
+int Controller::SpawnArrivals(double now_ms) {
+  int spawned = 0;
+  while (ArrivalsOpen() && next_arrival_ms_ <= now_ms) {
+    SpawnWorkflow();
+    ++spawned;
+    next_arrival_ms_ += arrival_rng_->Exponential(1000.0 / config_.arrival_rate_per_s);
+  }
+  return spawned;
+}
+
+// Caller must hold the owning shard's lock.
 bool Controller::IsCriticalPath(NodeId nid, WorkflowId wf_id) {
-  auto it = workflows_.find(wf_id);
-  if (it == workflows_.end()) return false;
+  WorkflowShard& shard = ShardFor(wf_id);
+  auto it = shard.owned.find(wf_id);
+  if (it == shard.owned.end()) return false;
   const Node& n = it->second->node(nid);
   return n.type == NodeType::Plan || n.type == NodeType::Aggregate ||
          n.type == NodeType::DecideNext || n.type == NodeType::ExtractEvidence;
@@ -86,19 +169,28 @@ void Controller::LaunchHedge(Workflow* wf, NodeId nid, double now_ms) {
   Node& n = wf->node_mut(nid);
   if (n.preference_list.size() < 2) return;
   const ExecutionOption* next_opt = &n.preference_list[1];
-  Tier* tier = provider_mgr_->GetTier(next_opt->provider, next_opt->tier_id);
-  if (!tier || !tier->can_accept()) return;
+  Tier* tier = provider_mgr_->GetTier(next_opt->provider_id, next_opt->tier_id);
+  if (!tier || !tier->can_accept() || !tier->has_queue_room()) return;
 
   const std::uint64_t key =
       (static_cast<std::uint64_t>(wf->id()) << 32) | static_cast<std::uint64_t>(nid);
-  auto* flag = new std::atomic<bool>(false);
-  cancelled_flags_[key] = flag;
+  // Share the primary attempt's token so whichever attempt resolves the node
+  // first invalidates the other; acquire a fresh one only if none exists.
+  WorkflowShard& shard = ShardFor(wf->id());
+  CancellationToken token;
+  auto tok_it = shard.cancel_tokens.find(key);
+  if (tok_it != shard.cancel_tokens.end()) {
+    token = tok_it->second;
+  } else {
+    token = cancel_pool_.Acquire();
+    shard.cancel_tokens[key] = token;
+  }
 
   QueuedAttempt attempt;
   attempt.node_id = nid;
   attempt.workflow_id = wf->id();
   attempt.node_type = n.type;
-  attempt.provider = next_opt->provider;
+  attempt.provider_id = next_opt->provider_id;
   attempt.tier_id = next_opt->tier_id;
   attempt.tokens_needed = 1;
   attempt.timeout_ms = next_opt->timeout_ms;
@@ -106,12 +198,22 @@ void Controller::LaunchHedge(Workflow* wf, NodeId nid, double now_ms) {
   attempt.latency_ctx.node_type = n.type;
   attempt.latency_ctx.token_length_est = n.output_size_est;
   attempt.attempt_id = next_attempt_id_.fetch_add(1);
-  attempt.cancelled = flag;
+  attempt.cancelled = token;
+  attempt.enqueue_ms = now_ms;  // hedges carry no score; aging alone orders them
 
   tier->Enqueue(std::move(attempt));
+  ++shard.workflow_counters[wf->id()].hedges_launched;
   if (trace_) trace_->Emit(TraceEvent::HedgeLaunched, now_ms, wf->id(), nid, "hedge");
 }
 
+void Controller::WakeScheduler() {
+  {
+    std::lock_guard lock(scheduler_wake_mutex_);
+    scheduler_wake_pending_ = true;
+  }
+  scheduler_wake_cv_.notify_one();
+}
+
 void Controller::SchedulerLoop() {
   const auto start = std::chrono::steady_clock::now();
   while (!shutdown_.load()) {
@@ -119,187 +221,685 @@ void Controller::SchedulerLoop() {
     const double now_ms =
         std::chrono::duration<double, std::milli>(now - start).count() * config_.time_scale;
 
-    {
-      std::lock_guard lock(workflows_mutex_);
-      std::unordered_map<WorkflowId, Workflow*> wf_ptrs;
-      for (auto& [id, wf] : workflows_) {
-        if (wf && !wf->done()) wf_ptrs[id] = wf.get();
-      }
-      scheduler_->Dispatch(
-          wf_ptrs, now_ms, workflow_cost_, workflow_start_ms_, next_attempt_id_, cancelled_flags_,
-          [this](NodeId nid, WorkflowId wfid) { return IsCriticalPath(nid, wfid); },
-          [this](WorkflowId wfid, NodeId nid, double dispatch_now_ms) {
-            if (workflow_start_ms_[wfid] < 0) workflow_start_ms_[wfid] = dispatch_now_ms;
-            const std::uint64_t key =
-                (static_cast<std::uint64_t>(wfid) << 32) | static_cast<std::uint64_t>(nid);
-            attempt_start_time_[key] = std::chrono::steady_clock::now();
-          });
-    }
-
-    std::this_thread::sleep_for(std::chrono::milliseconds(config_.scheduler_interval_ms));
+    scheduler_->Dispatch(
+        shard_views_, now_ms,
+        next_attempt_id_,
+        [this](NodeId nid, WorkflowId wfid) { return IsCriticalPath(nid, wfid); },
+        [this](WorkflowId wfid, NodeId nid, double dispatch_now_ms) {
+          WorkflowShard& shard = ShardFor(wfid);
+          if (shard.workflow_start_ms[wfid] == kNeverDispatched) {
+            shard.workflow_start_ms[wfid] = dispatch_now_ms;
+          }
+          if (hedging_enabled_) RegisterStragglerCheck(wfid, nid, dispatch_now_ms);
+        });
+
+    // Sleep until a completion wakes us; the interval is only a fallback.
+    std::unique_lock lock(scheduler_wake_mutex_);
+    scheduler_wake_cv_.wait_for(lock, std::chrono::milliseconds(config_.scheduler_interval_ms),
+                                [this] { return scheduler_wake_pending_ || shutdown_.load(); });
+    scheduler_wake_pending_ = false;
   }
 }
 
 void Controller::MonitorLoop() {
   const auto start = std::chrono::steady_clock::now();
+  // Advancing the timer wheel costs one slot check per elapsed millisecond
+  // regardless of outstanding timers, so the monitor can afford a 1 ms
+  // cadence instead of the old 10 ms heap poll.
   while (!shutdown_.load()) {
     const auto now = std::chrono::steady_clock::now();
     const double now_ms =
         std::chrono::duration<double, std::milli>(now - start).count() * config_.time_scale;
 
-    if (config_.enable_model_routing && !config_.disable_hedging &&
-        config_.policy == SchedulerPolicy::full) {
-      std::lock_guard lock(workflows_mutex_);
-      for (auto& [wf_id, wf] : workflows_) {
-        if (!wf || wf->done()) continue;
-        for (const auto& [nid, n] : wf->nodes()) {
-          if (n.state != NodeState::Queued) continue;
-          const std::uint64_t key =
-              (static_cast<std::uint64_t>(wf_id) << 32) | static_cast<std::uint64_t>(nid);
-          auto it = attempt_start_time_.find(key);
-          if (it == attempt_start_time_.end()) continue;
-          const double runtime_simulated_ms =
-              std::chrono::duration<double, std::milli>(now - it->second).count() *
-              static_cast<double>(config_.time_scale);
-          const double est_p95 =
-              latency_store_.GetP95(n.type, n.preference_list.empty() ? "" : n.preference_list[0].provider,
-                                   n.preference_list.empty() ? 0 : n.preference_list[0].tier_id);
-          const double stretch = est_p95 > 0 ? runtime_simulated_ms / est_p95 : 0;
-          if (stretch > config_.straggler_stretch_threshold && IsCriticalPath(nid, wf_id)) {
-            LaunchHedge(wf.get(), nid, now_ms);
-            break;
-          }
-        }
-      }
-    }
+    if (hedging_enabled_) RunDueTimers(now_ms);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+// Caller holds the owning shard's lock. Deadline = dispatch time plus the
+// stretch threshold times the current p95 for the node's primary option.
+void Controller::RegisterStragglerCheck(WorkflowId wf_id, NodeId nid, double now_ms) {
+  WorkflowShard& shard = ShardFor(wf_id);
+  auto it = shard.owned.find(wf_id);
+  if (it == shard.owned.end()) return;
+  const Node& n = it->second->node(nid);
+  if (n.preference_list.size() < 2) return;  // LaunchHedge would have nothing to escalate to
+  if (!IsCriticalPath(nid, wf_id)) return;
+  const double est_p95 =
+      latency_store_.GetP95(n.type, n.preference_list[0].provider_id, n.preference_list[0].tier_id);
+  if (est_p95 <= 0) return;
+  const double deadline_ms = now_ms + config_.straggler_stretch_threshold * est_p95;
+  std::lock_guard lock(timer_mutex_);
+  hedge_timers_.Schedule(deadline_ms, [this, wf_id, nid](double fire_now_ms) {
+    return HedgeCheckAction(wf_id, nid, fire_now_ms);
+  });
+}
+
+// Fired when a straggler deadline expires; returns the number of hedges
+// launched. The node state is re-validated here because the attempt may have
+// resolved or been retried since the timer was armed.
+int Controller::HedgeCheckAction(WorkflowId wf_id, NodeId nid, double now_ms) {
+  WorkflowShard& shard = ShardFor(wf_id);
+  std::lock_guard lock(shard.mutex);
+  auto it = shard.live.find(wf_id);
+  if (it == shard.live.end()) return 0;
+  Workflow* wf = it->second;
+  if (!wf || wf->done()) return 0;
+  const Node& n = wf->node(nid);
+  if (n.state != NodeState::Queued) return 0;  // resolved or retried since dispatch
+  LaunchHedge(wf, nid, now_ms);
+  // Still queued: re-arm with a refreshed p95 so persistent stragglers keep
+  // getting checked, mirroring the old periodic scan.
+  RegisterStragglerCheck(wf_id, nid, now_ms);
+  return 1;
+}
+
+int Controller::RunDueTimers(double now_ms) {
+  PerfScope perf_scope(&perf_, PerfPhase::monitor_scan);
+  // Collect expired actions first so shard locks are never taken under the
+  // timer lock; each action re-validates its own state when invoked.
+  due_timers_.clear();
+  {
+    std::lock_guard lock(timer_mutex_);
+    hedge_timers_.AdvanceTo(now_ms, due_timers_);
+  }
 
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  int work = 0;
+  for (TimerAction& action : due_timers_) {
+    work += action(now_ms);
   }
+  return work;
 }
 
-void Controller::ProcessResults() {
-  AttemptResult res;
-  while (result_queue_.TryPop(res)) {
-    std::lock_guard lock(workflows_mutex_);
-    auto wf_it = workflows_.find(res.workflow_id);
-    if (wf_it == workflows_.end()) continue;
+int Controller::ProcessResults(double now_ms) {
+  PerfScope perf_scope(&perf_, PerfPhase::process_results);
+  // Drain the whole queue in one lock acquisition, then walk the batch
+  // keeping a shard lock held across consecutive results for the same shard.
+  result_queue_.DrainAll(result_batch_);
+  int processed = 0;
+  WorkflowShard* locked_shard = nullptr;
+  std::unique_lock<std::mutex> lock;
+  for (AttemptResult& res : result_batch_) {
+    ++processed;
+    WorkflowShard& shard = ShardFor(res.workflow_id);
+    if (locked_shard != &shard) {
+      lock = std::unique_lock(shard.mutex);
+      locked_shard = &shard;
+    }
+    auto wf_it = shard.owned.find(res.workflow_id);
+    if (wf_it == shard.owned.end()) continue;
     Workflow* wf = wf_it->second.get();
     if (!wf || wf->done()) continue;
 
     Node& n = wf->node_mut(res.node_id);
-    if (IsTerminal(n.state)) continue;
+    if (IsTerminal(n.state)) {
+      // A hedge loser finishing after its node already resolved is the common
+      // cancellation shape; its service time was spent for nothing.
+      if (!res.success && res.error == "cancelled") {
+        WorkflowCounters& counters = shard.workflow_counters[res.workflow_id];
+        ++counters.cancellations;
+        counters.wasted_ms += res.duration_ms;
+      }
+      continue;
+    }
 
-    latency_store_.Record(n.type, res.provider, res.tier_id, res.duration_ms);
-    workflow_cost_[res.workflow_id] += res.cost;
+    latency_store_.Record(n.type, res.provider_id, res.tier_id, res.duration_ms);
+    shard.workflow_cost[res.workflow_id] += res.cost;
+
+    // Tier occupancy: every finished attempt (including hedge losers and
+    // cancellations, which held a slot until they resolved) contributes its
+    // service time, once the warm-up window has passed.
+    if (res.provider_id != kLocalProviderId && now_ms >= measure_start_ms_) {
+      if (Tier* t = provider_mgr_->GetTier(res.provider_id, res.tier_id)) {
+        tier_busy_ms_[t] += res.duration_ms;
+      }
+    }
 
     const std::uint64_t key =
         (static_cast<std::uint64_t>(res.workflow_id) << 32) | static_cast<std::uint64_t>(res.node_id);
 
     if (res.success) {
-      node_failure_count_.erase(key);
-      auto it = cancelled_flags_.find(key);
-      if (it != cancelled_flags_.end()) {
-        it->second->store(true);
+      shard.node_failure_count.erase(key);
+      auto it = shard.cancel_tokens.find(key);
+      if (it != shard.cancel_tokens.end()) {
+        // Recycle the slot; any still-running attempt for this node (a hedge
+        // loser) now reads cancelled via the generation check.
+        cancel_pool_.Release(it->second);
+        shard.cancel_tokens.erase(it);
       }
       wf->MarkSucceeded(res.node_id);
       if (trace_) trace_->Emit(TraceEvent::AttemptFinish, res.duration_ms, res.workflow_id,
                                res.node_id, "ok");
     } else {
+      // Any unsuccessful completion spent its service time without resolving
+      // the node; fold it into the workflow's waste tally.
+      WorkflowCounters& counters = shard.workflow_counters[res.workflow_id];
+      counters.wasted_ms += res.duration_ms;
       if (res.error == "cancelled") {
-        wf->Cancel(res.node_id);
+        // A cancelled attempt never resolves its node: cancellation only
+        // originates from the node being resolved elsewhere (a hedge winner,
+        // a retry re-dispatch, or workflow completion), and that path owns
+        // the node's state. Cancelling here could kill a node whose newer
+        // attempt is still in flight.
+        ++counters.cancellations;
         if (trace_) trace_->Emit(TraceEvent::AttemptCancel, res.duration_ms, res.workflow_id,
-                                 res.node_id, "hedge_loser");
+                                 res.node_id, "stale_attempt");
       } else {
         int max_retries = 0;
-        if (Tier* t = provider_mgr_->GetTier(res.provider, res.tier_id)) {
+        if (Tier* t = provider_mgr_->GetTier(res.provider_id, res.tier_id)) {
           max_retries = t->config().default_max_retries;
         }
-        const int fails = ++node_failure_count_[key];
+        const int fails = ++shard.node_failure_count[key];
         const bool can_retry = n.idempotent && (fails <= max_retries);
         if (can_retry) {
+          ++counters.retries;
           wf->Retry(res.node_id);
           if (trace_) trace_->Emit(TraceEvent::AttemptFail, res.duration_ms, res.workflow_id,
                                    res.node_id, res.error + "_retry");
         } else {
           wf->MarkFailed(res.node_id);
+          auto it = shard.cancel_tokens.find(key);
+          if (it != shard.cancel_tokens.end()) {
+            cancel_pool_.Release(it->second);
+            shard.cancel_tokens.erase(it);
+          }
           if (trace_) trace_->Emit(TraceEvent::AttemptFail, res.duration_ms, res.workflow_id,
                                    res.node_id, res.error);
         }
       }
     }
 
-    attempt_start_time_.erase(key);
     if (wf->done()) {
       workflows_done_.fetch_add(1);
-      const double start_ms = workflow_start_ms_[res.workflow_id];
-      const double now_simulated_ms =
-          std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - run_start_)
-              .count() *
-          static_cast<double>(config_.time_scale);
-      WorkflowMetrics m;
-      m.workflow_id = res.workflow_id;
-      m.makespan_ms = (start_ms >= 0) ? (now_simulated_ms - start_ms) : now_simulated_ms;
-      m.cost = workflow_cost_[res.workflow_id];
-      workflow_metrics_.push_back(m);
-      if (trace_) trace_->Emit(TraceEvent::WorkflowDone, m.makespan_ms, res.workflow_id, 0, "");
+      shard.live.erase(res.workflow_id);
+      // Sweep remaining tokens for this workflow (pruned or never-resolved
+      // nodes) so the map stays bounded and in-flight leftovers cancel.
+      for (auto it = shard.cancel_tokens.begin(); it != shard.cancel_tokens.end();) {
+        if ((it->first >> 32) == res.workflow_id) {
+          cancel_pool_.Release(it->second);
+          it = shard.cancel_tokens.erase(it);
+        } else {
+          ++it;
+        }
+      }
+      const double start_ms = shard.workflow_start_ms[res.workflow_id];
+      const double makespan_ms = (start_ms != kNeverDispatched) ? (now_ms - start_ms) : now_ms;
+      const double cost = shard.workflow_cost[res.workflow_id];
+      // Open-loop runs exclude workflows first dispatched during warm-up, so
+      // the histograms (and the throughput derived from their count) describe
+      // the steady state rather than the empty-system transient.
+      const bool measured =
+          !open_loop_ || (start_ms != kNeverDispatched && start_ms >= measure_start_ms_);
+      if (measured) {
+        makespan_hist_.Record(makespan_ms);
+        cost_hist_.Record(cost);
+        const WorkflowCounters& counters = shard.workflow_counters[res.workflow_id];
+        const WorkflowRecord rec{res.workflow_id, counters.retries, counters.cancellations,
+                                 counters.hedges_launched, makespan_ms, cost, counters.wasted_ms};
+        workflows_bin_->Append(&rec, sizeof(rec));
+      }
+      if (trace_) trace_->Emit(TraceEvent::WorkflowDone, makespan_ms, res.workflow_id, 0, "");
+
+      // Everything worth keeping is now folded into the histograms and the
+      // appended binary record; drop the DAG and per-workflow bookkeeping so
+      // resident state tracks concurrent workflows, not total workflows.
+      for (auto it = shard.node_failure_count.begin(); it != shard.node_failure_count.end();) {
+        it = ((it->first >> 32) == res.workflow_id) ? shard.node_failure_count.erase(it)
+                                                    : std::next(it);
+      }
+      shard.workflow_start_ms.erase(res.workflow_id);
+      shard.workflow_cost.erase(res.workflow_id);
+      shard.workflow_counters.erase(res.workflow_id);
+      scheduler_->ForgetWorkflow(res.workflow_id);
+      shard.owned.erase(res.workflow_id);
     }
   }
+
+  // Rewrite summary.csv with the cumulative distribution so far. Rewriting
+  // the single row (rather than appending interval rows) keeps the one-row
+  // shape bench/collect.py expects while still giving live percentiles.
+  if (makespan_hist_.Count() > 0 && now_ms - last_summary_write_ms_ >= kSummaryRewriteMs) {
+    last_summary_write_ms_ = now_ms;
+    summary_metrics_ = SummaryFromHistograms();
+    WriteSummaryCsv(config_.out_dir, summary_metrics_);
+  }
+  return processed;
 }
 
 void Controller::Run() {
   run_start_ = std::chrono::steady_clock::now();
-  for (auto& [id, wf] : workflows_) {
-    workflow_start_ms_[id] = -1;
-    workflow_cost_[id] = 0;
-    wf->RefreshRunnable();
+
+  if (config_.engine == EngineMode::des) {
+    RunDes();
+    WriteOutputs();
+    return;
   }
 
   scheduler_thread_ = std::thread(&Controller::SchedulerLoop, this);
   monitor_thread_ = std::thread(&Controller::MonitorLoop, this);
 
-  while (workflows_done_.load() < config_.workflows) {
-    ProcessResults();
-    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  while (open_loop_ || workflows_done_.load() < config_.workflows) {
+    // Wait for a completion (10 ms fallback), then drain and wake the
+    // scheduler so newly runnable children dispatch without polling delay.
+    result_queue_.WaitForResult(std::chrono::milliseconds(10));
+    const double now_ms =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - run_start_)
+            .count() *
+        static_cast<double>(config_.time_scale);
+    if (open_loop_ && now_ms >= duration_ms_) {
+      duration_reached_ = true;
+      break;
+    }
+    int work = ProcessResults(now_ms);
+    if (config_.arrival == ArrivalMode::poisson) work += SpawnArrivals(now_ms);
+    if (work > 0) WakeScheduler();
   }
+  run_end_ms_ =
+      std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - run_start_)
+          .count() *
+      static_cast<double>(config_.time_scale);
+  if (open_loop_) run_end_ms_ = std::min(run_end_ms_, duration_ms_);
 
   shutdown_.store(true);
   if (scheduler_thread_.joinable()) scheduler_thread_.join();
   if (monitor_thread_.joinable()) monitor_thread_.join();
 
-  const auto end = std::chrono::steady_clock::now();
-  (void)end;
-
-  std::vector<double> makespans;
-  std::vector<double> costs;
-  for (const auto& m : workflow_metrics_) {
-    makespans.push_back(m.makespan_ms);
-    costs.push_back(m.cost);
-  }
-  std::sort(makespans.begin(), makespans.end());
-  std::sort(costs.begin(), costs.end());
-  const std::size_t n = makespans.size();
-  if (n > 0) {
-    summary_metrics_.makespan_mean_ms =
-        std::accumulate(makespans.begin(), makespans.end(), 0.0) / static_cast<double>(n);
-    summary_metrics_.makespan_p50_ms = makespans[n / 2];
-    summary_metrics_.makespan_p95_ms = makespans[static_cast<std::size_t>(0.95 * n)];
-    summary_metrics_.makespan_p99_ms = makespans[static_cast<std::size_t>(0.99 * n)];
-    summary_metrics_.cost_mean =
-        std::accumulate(costs.begin(), costs.end(), 0.0) / static_cast<double>(n);
-    summary_metrics_.cost_p50 = costs[n / 2];
-  }
+  WriteOutputs();
+}
+
+void Controller::WriteOutputs() {
+  // All emitters have stopped by now: drain and trim the binary files. The
+  // JSON trace and per-workflow CSV are rendered offline by --convert so the
+  // run never pays for text formatting.
+  if (trace_) trace_->Close();
+  if (workflows_bin_) workflows_bin_->Close();
+  if (replay_log_) replay_log_->Close();
+  summary_metrics_ = SummaryFromHistograms();
+
+  // Measurement window for rate-style figures: warm-up end to run end.
+  const double window_ms = std::max(1.0, run_end_ms_ - measure_start_ms_);
+  summary_metrics_.throughput_wps =
+      static_cast<double>(makespan_hist_.Count()) / (window_ms / 1000.0);
 
   std::vector<TierStats> tier_stats;
   for (const auto& t : provider_mgr_->tiers()) {
     TierStats s;
     s.provider = t->provider();
     s.tier_id = t->tier_id();
-    s.queue_wait_p95_ms = latency_store_.GetP95QueueWait(s.provider, s.tier_id);
+    s.queue_wait_p95_ms = latency_store_.GetP95QueueWait(t->provider_id(), s.tier_id);
+    s.queue_depth = t->queue_depth();
+    // Time-averaged occupancy from accumulated attempt service time; dividing
+    // by the concurrency cap turns it into utilization of the tier's slots.
+    const auto busy_it = tier_busy_ms_.find(t.get());
+    const double busy_ms = busy_it != tier_busy_ms_.end() ? busy_it->second : 0.0;
+    const double avg_in_flight = busy_ms / window_ms;
+    s.in_flight_avg = static_cast<int>(std::lround(avg_in_flight));
+    if (t->config().concurrency_cap > 0) {
+      s.utilization = avg_in_flight / static_cast<double>(t->config().concurrency_cap);
+    }
     tier_stats.push_back(s);
   }
-  WriteWorkflowsCsv(config_.out_dir, workflow_metrics_);
   WriteTiersCsv(config_.out_dir, tier_stats);
   WriteSummaryCsv(config_.out_dir, summary_metrics_);
+  perf_.WriteCsv(config_.out_dir);
+}
+
+SummaryMetrics Controller::SummaryFromHistograms() const {
+  SummaryMetrics s;
+  if (makespan_hist_.Count() == 0) return s;
+  s.makespan_mean_ms = makespan_hist_.Mean();
+  s.makespan_p50_ms = makespan_hist_.Percentile(50.0);
+  s.makespan_p95_ms = makespan_hist_.Percentile(95.0);
+  s.makespan_p99_ms = makespan_hist_.Percentile(99.0);
+  s.cost_mean = cost_hist_.Mean();
+  s.cost_p50 = cost_hist_.Percentile(50.0);
+  return s;
+}
+
+// -----------------------------------------------------------------------------
+// Snapshot / resume (DES only)
+// -----------------------------------------------------------------------------
+//
+// The snapshot captures everything a resumed run needs to skip a shared
+// warm-up: workflow graphs and node states, per-workflow cost and start
+// bookkeeping, the makespan/cost histograms, latency estimates, RNG states,
+// and counters. Attempts in flight when the snapshot fires are not events
+// the resumed process can replay, so their nodes come back Runnable and are
+// re-dispatched; restored times are shifted so the resumed virtual clock
+// starts at zero.
+
+static constexpr char kSnapshotMagic[4] = {'A', 'S', 'N', 'P'};
+static constexpr std::uint32_t kSnapshotVersion = 4;
+
+void Controller::WriteSnapshot(const std::string& path) {
+  std::ofstream out(path, std::ios::binary);
+  if (!out) throw std::runtime_error("Failed to open snapshot file: " + path);
+  const double now_ms = event_loop_->now_ms();
+
+  out.write(kSnapshotMagic, sizeof(kSnapshotMagic));
+  snap::Write(out, kSnapshotVersion);
+  snap::Write(out, config_.workflows);
+  snap::Write(out, config_.pdfs);
+  snap::Write(out, config_.iters);
+  snap::Write(out, config_.subqueries);
+  snap::Write(out, config_.seed);
+
+  snap::Write(out, now_ms);
+  snap::Write(out, workflows_done_.load());
+  snap::Write(out, workflows_spawned_);
+  snap::Write(out, next_workflow_id_);
+  snap::Write(out, next_attempt_id_.load());
+  for (std::uint64_t s : rng_->State()) snap::Write(out, s);
+  snap::Write(out, arrival_rng_ != nullptr);
+  if (arrival_rng_) {
+    for (std::uint64_t s : arrival_rng_->State()) snap::Write(out, s);
+  }
+
+  latency_store_.SaveTo(out);
+
+  makespan_hist_.SaveTo(out);
+  cost_hist_.SaveTo(out);
+
+  std::uint64_t live_count = 0;
+  for (WorkflowShard& shard : shards_) {
+    std::lock_guard lock(shard.mutex);
+    live_count += shard.owned.size();
+  }
+  snap::Write(out, live_count);
+  for (WorkflowShard& shard : shards_) {
+    std::lock_guard lock(shard.mutex);
+    for (const auto& [wf_id, wf] : shard.owned) {
+      wf->SaveTo(out);
+      snap::Write(out, shard.workflow_start_ms[wf_id]);
+      snap::Write(out, shard.workflow_cost[wf_id]);
+      const WorkflowCounters& counters = shard.workflow_counters[wf_id];
+      snap::Write(out, counters.retries);
+      snap::Write(out, counters.cancellations);
+      snap::Write(out, counters.hedges_launched);
+      snap::Write(out, counters.wasted_ms);
+    }
+  }
+  if (!out) throw std::runtime_error("Failed to write snapshot: " + path);
+}
+
+void Controller::LoadSnapshot(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) throw std::runtime_error("Failed to open snapshot file: " + path);
+
+  char magic[4];
+  in.read(magic, sizeof(magic));
+  if (!in || std::memcmp(magic, kSnapshotMagic, sizeof(magic)) != 0) {
+    throw std::runtime_error("Not a snapshot file: " + path);
+  }
+  if (snap::Read<std::uint32_t>(in) != kSnapshotVersion) {
+    throw std::runtime_error("Unsupported snapshot version: " + path);
+  }
+  // The workload shape must match; sweeps vary only scheduler parameters.
+  if (snap::Read<int>(in) != config_.workflows || snap::Read<int>(in) != config_.pdfs ||
+      snap::Read<int>(in) != config_.iters || snap::Read<int>(in) != config_.subqueries ||
+      snap::Read<std::uint64_t>(in) != config_.seed) {
+    throw std::runtime_error("Snapshot workload does not match this configuration: " + path);
+  }
+
+  const double snap_now_ms = snap::Read<double>(in);
+  workflows_done_.store(snap::Read<int>(in));
+  workflows_spawned_ = snap::Read<int>(in);
+  next_workflow_id_ = snap::Read<WorkflowId>(in);
+  next_attempt_id_.store(snap::Read<AttemptId>(in));
+  std::array<std::uint64_t, 4> rng_state;
+  for (std::uint64_t& s : rng_state) s = snap::Read<std::uint64_t>(in);
+  rng_->SetState(rng_state);
+  if (snap::Read<bool>(in)) {
+    std::array<std::uint64_t, 4> arrival_state;
+    for (std::uint64_t& s : arrival_state) s = snap::Read<std::uint64_t>(in);
+    if (!arrival_rng_) arrival_rng_ = std::make_unique<SeededRng>(config_.seed + 1);
+    arrival_rng_->SetState(arrival_state);
+  }
+
+  latency_store_.LoadFrom(in);
+
+  // Per-workflow records are not snapshotted: a resumed run's workflows.bin
+  // covers only post-resume completions; the histograms carry the summary
+  // across both halves.
+  makespan_hist_.LoadFrom(in);
+  cost_hist_.LoadFrom(in);
+
+  const ProviderConfig* wf_provider = config_.enable_model_routing ? &provider_config_ : nullptr;
+  const auto live_count = snap::Read<std::uint64_t>(in);
+  for (std::uint64_t i = 0; i < live_count; ++i) {
+    auto wf = Workflow::LoadFrom(in, wf_provider);
+    const double start_ms = snap::Read<double>(in);
+    const double cost = snap::Read<double>(in);
+    WorkflowCounters counters;
+    counters.retries = snap::Read<std::int32_t>(in);
+    counters.cancellations = snap::Read<std::int32_t>(in);
+    counters.hedges_launched = snap::Read<std::int32_t>(in);
+    counters.wasted_ms = snap::Read<double>(in);
+
+    WorkflowShard& shard = ShardFor(wf->id());
+    std::lock_guard lock(shard.mutex);
+    const WorkflowId id = wf->id();
+    shard.live[id] = wf.get();
+    // Shift to the resumed clock (which restarts at zero); a workflow first
+    // dispatched before the snapshot keeps a negative start so its makespan
+    // still spans both runs. -1 stays the never-dispatched sentinel.
+    shard.workflow_start_ms[id] =
+        start_ms != kNeverDispatched ? start_ms - snap_now_ms : kNeverDispatched;
+    shard.workflow_cost[id] = cost;
+    shard.workflow_counters[id] = counters;
+    shard.owned[id] = std::move(wf);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Discrete-event engine
+// -----------------------------------------------------------------------------
+//
+// Uses the same Scheduler, tier queues, and result pipeline as the real-time
+// engine, but service completions, scheduler ticks, and monitor checks are
+// events on a virtual clock, so a run's wall time is independent of
+// time_scale. Tick cadences mirror the real-time engine: a wall interval of
+// I ms corresponds to I * time_scale virtual ms.
+
+void Controller::RunDes() {
+  if (!config_.resume_file.empty()) LoadSnapshot(config_.resume_file);
+  if (config_.snapshot_at_ms >= 0) {
+    event_loop_->Schedule(config_.snapshot_at_ms,
+                          [this] { WriteSnapshot(config_.out_dir + "/snapshot.bin"); });
+  }
+  if (open_loop_) {
+    event_loop_->Schedule(duration_ms_, [this] { duration_reached_ = true; });
+  }
+  if (config_.arrival == ArrivalMode::poisson && ArrivalsOpen()) {
+    if (config_.resume_file.empty()) {
+      event_loop_->Schedule(0.0, [this] { DesArrival(); });
+    } else {
+      // The pending arrival event is not part of the snapshot; by the
+      // memorylessness of the exponential, a fresh draw is distributionally
+      // exact for the time to the next arrival.
+      event_loop_->ScheduleAfter(arrival_rng_->Exponential(1000.0 / config_.arrival_rate_per_s),
+                                 [this] { DesArrival(); });
+    }
+  }
+  event_loop_->Schedule(0.0, [this] { DesSchedulerTick(); });
+  event_loop_->Schedule(0.0, [this] { DesMonitorTick(); });
+
+  while (!duration_reached_ &&
+         (open_loop_ || workflows_done_.load() < config_.workflows) &&
+         event_loop_->RunOne()) {
+  }
+  run_end_ms_ = event_loop_->now_ms();
+}
+
+void Controller::DesArrival() {
+  SpawnWorkflow();
+  // Dispatch the new arrival promptly rather than waiting for the fallback
+  // tick; coalesced like completion-driven dispatches.
+  if (!des_dispatch_pending_) {
+    des_dispatch_pending_ = true;
+    event_loop_->ScheduleAfter(0.0, [this] {
+      des_dispatch_pending_ = false;
+      DesDispatchOnce();
+    });
+  }
+  if (ArrivalsOpen()) {
+    event_loop_->ScheduleAfter(arrival_rng_->Exponential(1000.0 / config_.arrival_rate_per_s),
+                               [this] { DesArrival(); });
+  }
+}
+
+void Controller::DesDispatchOnce() {
+  const double now_ms = event_loop_->now_ms();
+  scheduler_->Dispatch(
+      shard_views_, now_ms,
+      next_attempt_id_,
+      [this](NodeId nid, WorkflowId wfid) { return IsCriticalPath(nid, wfid); },
+      [this](WorkflowId wfid, NodeId nid, double dispatch_now_ms) {
+        WorkflowShard& shard = ShardFor(wfid);
+        if (shard.workflow_start_ms[wfid] == kNeverDispatched) {
+          shard.workflow_start_ms[wfid] = dispatch_now_ms;
+        }
+        if (hedging_enabled_) RegisterStragglerCheck(wfid, nid, dispatch_now_ms);
+      });
+
+  DesDrainTiers();
+  DesDrainLocal();
+}
+
+void Controller::DesSchedulerTick() {
+  DesDispatchOnce();
+  // Fallback cadence only; completions schedule immediate dispatches.
+  event_loop_->ScheduleAfter(
+      static_cast<double>(config_.scheduler_interval_ms) * config_.time_scale,
+      [this] { DesSchedulerTick(); });
+}
+
+void Controller::DesMonitorTick() {
+  const double now_ms = event_loop_->now_ms();
+
+  if (hedging_enabled_ && RunDueTimers(now_ms) > 0) {
+    DesDrainTiers();
+  }
+
+  // 1 ms wall cadence: the wheel advance is O(elapsed ms) with empty-slot
+  // skipping, so the finer tick costs only the extra events.
+  event_loop_->ScheduleAfter(1.0 * config_.time_scale, [this] { DesMonitorTick(); });
+}
+
+void Controller::DesDrainTiers() {
+  for (const auto& tier_ptr : provider_mgr_->tiers()) {
+    Tier* tier = tier_ptr.get();
+    QueuedAttempt attempt;
+    while (tier->TryDequeue(attempt)) {
+      const double now_ms = event_loop_->now_ms();
+      const TierConfig& tc = tier->config();
+
+      // Virtual token bucket: draw down immediately; a deficit delays the
+      // start by the time the refill needs to cover it.
+      DesTierTokens& bucket = des_tier_tokens_[tier];
+      const double elapsed_s = (now_ms - bucket.last_refill_ms) / 1000.0;
+      bucket.tokens = std::min(tc.capacity, bucket.tokens + elapsed_s * tc.rate_per_sec);
+      bucket.last_refill_ms = now_ms;
+      bucket.tokens -= static_cast<double>(attempt.tokens_needed);
+      const double token_wait_ms =
+          bucket.tokens >= 0.0 ? 0.0 : (-bucket.tokens / tc.rate_per_sec) * 1000.0;
+
+      LatencySample sample;
+      if (!replay_source_ ||
+          !replay_source_->Next(attempt.workflow_id, attempt.node_id, &sample)) {
+        sample = sampler_->Sample(attempt.latency_ctx, attempt.timeout_ms, tc.p_fail);
+        if (config_.heavy_tail_prob > 0.0 && rng_->Bernoulli(config_.heavy_tail_prob)) {
+          sample.service_time_ms *= config_.heavy_tail_multiplier;
+        }
+      }
+      if (replay_log_) replay_log_->Record(attempt.workflow_id, attempt.node_id, sample);
+
+      AttemptResult res;
+      res.node_id = attempt.node_id;
+      res.workflow_id = attempt.workflow_id;
+      res.attempt_id = attempt.attempt_id;
+      res.provider_id = attempt.provider_id;
+      res.tier_id = attempt.tier_id;
+      res.duration_ms = sample.service_time_ms;
+      res.cost = tc.price_per_call;
+      if (sample.failed) {
+        res.success = false;
+        res.error = "failed";
+      } else if (sample.timeout) {
+        res.success = false;
+        res.error = "timeout";
+      } else {
+        res.success = true;
+      }
+
+      CancellationToken cancelled = attempt.cancelled;
+      event_loop_->ScheduleAfter(
+          token_wait_ms + sample.service_time_ms,
+          [this, tier, res = std::move(res), cancelled]() mutable {
+            if (cancelled.IsCancelled()) {
+              res.success = false;
+              res.error = "cancelled";
+            }
+            tier->OnAttemptFinish();
+            DesCompleteAttempt(std::move(res));
+          });
+    }
+  }
+}
+
+void Controller::DesDrainLocal() {
+  LocalTask task;
+  while (des_local_slots_ > 0 && local_queue_.TryPop(task)) {
+    --des_local_slots_;
+    LatencySample local_sample;
+    if (!replay_source_ || !replay_source_->Next(task.workflow_id, task.node_id, &local_sample)) {
+      local_sample.service_time_ms = SampleLocalServiceTime(
+          task.node_type, task.latency_ctx, provider_config_.latency, rng_.get());
+      if (config_.heavy_tail_prob > 0.0 && rng_->Bernoulli(config_.heavy_tail_prob)) {
+        local_sample.service_time_ms *= config_.heavy_tail_multiplier;
+      }
+    }
+    if (replay_log_) replay_log_->Record(task.workflow_id, task.node_id, local_sample);
+    const double raw_ms = local_sample.service_time_ms;
+
+    AttemptResult res;
+    res.node_id = task.node_id;
+    res.workflow_id = task.workflow_id;
+    res.attempt_id = task.attempt_id;
+    res.provider_id = kLocalProviderId;
+    res.tier_id = static_cast<int>(task.resource_class);
+    res.duration_ms = raw_ms;
+    res.cost = 0.0;
+    res.success = true;
+
+    CancellationToken cancelled = task.cancelled;
+    event_loop_->ScheduleAfter(raw_ms, [this, res = std::move(res), cancelled]() mutable {
+      if (cancelled.IsCancelled()) {
+        res.success = false;
+        res.error = "cancelled";
+      }
+      ++des_local_slots_;
+      DesCompleteAttempt(std::move(res));
+    });
+  }
+}
+
+void Controller::DesCompleteAttempt(AttemptResult res) {
+  result_queue_.Push(std::move(res));
+  ProcessResults(event_loop_->now_ms());
+  // A freed slot or new runnable work may let queued attempts start.
+  DesDrainTiers();
+  DesDrainLocal();
+  // Dispatch newly runnable children right away instead of waiting for the
+  // periodic tick; coalesce bursts of completions into one dispatch event.
+  if (!des_dispatch_pending_) {
+    des_dispatch_pending_ = true;
+    event_loop_->ScheduleAfter(0.0, [this] {
+      des_dispatch_pending_ = false;
+      DesDispatchOnce();
+    });
+  }
 }
 
 }  // namespace sim
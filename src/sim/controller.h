@@ -1,24 +1,49 @@
           #pragma once
 
+#include "sim/cancellation.h"
 #include "sim/config.h"
+#include "sim/event_loop.h"
+#include "sim/mapped_file.h"
 #include "sim/metrics.h"
+#include "sim/perf.h"
 #include "sim/provider.h"
+#include "sim/replay.h"
 #include "sim/scheduler.h"
+#include "sim/timer_wheel.h"
 #include "sim/trace.h"
 #include "sim/types.h"
 #include "sim/workflow.h"
 #include "sim/worker.h"
 
+#include <array>
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <fstream>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <unordered_map>
 
 namespace sim {
 
+// Execution engine: realtime advances via scaled wall-clock sleeps; des runs a
+// virtual-clock discrete-event loop where the clock jumps between events.
+enum class EngineMode {
+  realtime,
+  des,
+};
+
+// Arrival process: all_at_start constructs every workflow before the run (the
+// original closed-loop setup); poisson constructs each workflow lazily when
+// its arrival event fires and destroys it on completion, so memory scales
+// with concurrent workflows rather than total workflows.
+enum class ArrivalMode {
+  all_at_start,
+  poisson,
+};
+
 struct ControllerConfig {
   int workflows = 100;
   int pdfs = 10;
@@ -36,6 +61,31 @@ struct ControllerConfig {
   double heavy_tail_prob = 0.02;      // 1-5% of tasks get heavy-tail multiplier
   double heavy_tail_multiplier = 50.0;  // multiplier for heavy-tail tasks
   bool enable_model_routing = false;
+  EngineMode engine = EngineMode::realtime;
+  ArrivalMode arrival = ArrivalMode::all_at_start;
+  double arrival_rate_per_s = 10.0;  // workflows per simulated second (poisson only)
+
+  // Snapshot/resume (DES only): snapshot_at_ms >= 0 writes out_dir/snapshot.bin
+  // at that virtual time; resume_file restores one before the run starts, so
+  // repeated sweeps skip a shared warm-up phase.
+  double snapshot_at_ms = -1.0;
+  std::string resume_file;
+
+  // Outcome record/replay: record_outcomes persists every sampled service
+  // time and failure draw to out_dir/outcomes.bin; replay_file feeds a prior
+  // run's outcomes back into sampling, so policy comparisons see the same
+  // workload realization instead of fresh RNG draws.
+  bool record_outcomes = false;
+  std::string replay_file;
+
+  // Open-loop load generation (requires poisson arrivals): duration_s > 0
+  // keeps workflows arriving for the whole window instead of stopping after
+  // `workflows`, and the run ends when the window closes. Workflows first
+  // dispatched during the warm-up prefix are excluded from the summary
+  // histograms and throughput, so the reported figures are steady-state.
+  // warmup_s < 0 defaults to 10% of the duration.
+  double duration_s = -1.0;
+  double warmup_s = -1.0;
 };
 
 class Controller {
@@ -44,50 +94,156 @@ class Controller {
   ~Controller();
 
   void Run();
-  const std::vector<WorkflowMetrics>& workflow_metrics() const { return workflow_metrics_; }
   const SummaryMetrics& summary_metrics() const { return summary_metrics_; }
 
  private:
   void SchedulerLoop();
   void MonitorLoop();
-  void ProcessResults();
+  int ProcessResults(double now_ms);
+  void WakeScheduler();
   bool IsCriticalPath(NodeId nid, WorkflowId wf_id);
   void LaunchHedge(Workflow* wf, NodeId nid, double now_ms);
+  SummaryMetrics SummaryFromHistograms() const;
+  void WriteOutputs();
+  Workflow* SpawnWorkflow();
+  int SpawnArrivals(double now_ms);
+  bool ArrivalsOpen() const;
+  void RegisterStragglerCheck(WorkflowId wf_id, NodeId nid, double now_ms);
+  int HedgeCheckAction(WorkflowId wf_id, NodeId nid, double now_ms);
+  int RunDueTimers(double now_ms);
+  void WriteSnapshot(const std::string& path);
+  void LoadSnapshot(const std::string& path);
+
+  // Discrete-event engine: the same dispatch/result pipeline driven by a
+  // virtual clock instead of worker threads and wall-clock sleeps.
+  void RunDes();
+  void DesDispatchOnce();
+  void DesSchedulerTick();
+  void DesMonitorTick();
+  void DesDrainTiers();
+  void DesDrainLocal();
+  void DesCompleteAttempt(AttemptResult res);
+  void DesArrival();
 
   ControllerConfig config_;
   ProviderConfig provider_config_;
   std::unique_ptr<ProviderManager> provider_mgr_;
   LatencyEstimateStore latency_store_;
+  CancellationPool cancel_pool_;
   ResultQueue result_queue_;
-  LocalQueue cpu_queue_;
-  LocalQueue io_queue_;
+  LocalQueue local_queue_;
 
-  std::unordered_map<WorkflowId, std::unique_ptr<Workflow>> workflows_;
-  std::unordered_map<WorkflowId, double> workflow_start_ms_;
-  std::unordered_map<WorkflowId, double> workflow_cost_;
-  std::unordered_map<std::uint64_t, std::atomic<bool>*> cancelled_flags_;
-  std::unordered_map<std::uint64_t, std::chrono::steady_clock::time_point> attempt_start_time_;
-  std::unordered_map<std::uint64_t, int> node_failure_count_;
+  // Workflow state is partitioned into shards, each guarded by its own mutex,
+  // so result processing, dispatch, and the straggler monitor contend only
+  // when touching the same shard instead of convoying on one global lock.
+  static constexpr int kNumShards = 8;
+  // workflow_start_ms value meaning "not yet dispatched". Compared by
+  // equality: resumed workflows carry negative shifted starts that are real
+  // dispatch times, not this sentinel.
+  static constexpr double kNeverDispatched = -1.0;
+  // Per-live-workflow event counters folded into the WorkflowRecord when the
+  // workflow completes; updated under the shard lock alongside workflow_cost.
+  struct WorkflowCounters {
+    std::int32_t retries = 0;
+    std::int32_t cancellations = 0;
+    std::int32_t hedges_launched = 0;
+    double wasted_ms = 0.0;  // service time of attempts that did not resolve their node
+  };
+  struct WorkflowShard {
+    std::mutex mutex;
+    std::unordered_map<WorkflowId, std::unique_ptr<Workflow>> owned;
+    std::unordered_map<WorkflowId, Workflow*> live;  // not-done subset, scheduler's view
+    std::unordered_map<WorkflowId, double> workflow_start_ms;
+    std::unordered_map<WorkflowId, double> workflow_cost;
+    std::unordered_map<WorkflowId, WorkflowCounters> workflow_counters;
+    std::unordered_map<std::uint64_t, CancellationToken> cancel_tokens;
+    std::unordered_map<std::uint64_t, int> node_failure_count;
+  };
+  WorkflowShard& ShardFor(WorkflowId id) {
+    return shards_[id % static_cast<WorkflowId>(kNumShards)];
+  }
+
+  std::array<WorkflowShard, kNumShards> shards_;
+  std::vector<ShardView> shard_views_;
+
+  // Deadline timers: each hedgeable dispatch registers a straggler check
+  // (dispatch time + stretch_threshold * current p95) in a hierarchical timer
+  // wheel -- O(1) insert and ~1 ms firing precision, versus the former
+  // min-heap's O(log n) insert under a 10 ms poll. Actions are validated
+  // against node state when fired and re-armed while still queued; attempt
+  // timeouts or backoff timers can share the same wheel.
+  std::mutex timer_mutex_;
+  TimerWheel hedge_timers_;
+  std::vector<TimerAction> due_timers_;  // RunDueTimers scratch, reused across calls
+  bool hedging_enabled_ = false;
+
+  // DES-only state: virtual token buckets per tier and local worker slots.
+  struct DesTierTokens {
+    double tokens = 0.0;
+    double last_refill_ms = 0.0;
+  };
+  std::unique_ptr<EventLoop> event_loop_;
+  std::unordered_map<Tier*, DesTierTokens> des_tier_tokens_;
+  // Unified local capacity (formerly 4 cpu + 2 io); kept fixed rather than
+  // host-sized so DES runs are reproducible across machines.
+  int des_local_slots_ = 6;
 
   std::atomic<AttemptId> next_attempt_id_{1};
   std::atomic<bool> shutdown_{false};
   std::atomic<int> workflows_done_{0};
 
+  // Arrival-process state. The arrival stream has its own RNG so interarrival
+  // draws do not perturb the service-time sequence (and the executor thread's
+  // rng_ use stays unshared in realtime mode).
+  WorkflowId next_workflow_id_ = 1;
+  int workflows_spawned_ = 0;
+  double next_arrival_ms_ = 0.0;
+  std::unique_ptr<SeededRng> arrival_rng_;
+
+  // Open-loop load-generation state (see ControllerConfig::duration_s).
+  bool open_loop_ = false;
+  double duration_ms_ = 0.0;
+  double measure_start_ms_ = 0.0;  // warm-up end; 0 in closed-loop runs
+  double run_end_ms_ = 0.0;        // virtual time when the run stopped
+  bool duration_reached_ = false;
+  // Busy virtual-ms per tier, accumulated as attempts complete; divided by
+  // the measurement window in WriteOutputs to yield utilization and the
+  // time-averaged in-flight count.
+  std::unordered_map<Tier*, double> tier_busy_ms_;
+
   std::unique_ptr<SeededRng> rng_;
   std::unique_ptr<LatencySampler> sampler_;
   std::unique_ptr<Scheduler> scheduler_;
-  std::ofstream trace_file_;
   std::unique_ptr<TraceWriter> trace_;
+  std::unique_ptr<ReplayLog> replay_log_;
+  std::unique_ptr<ReplaySource> replay_source_;
 
-  std::vector<std::thread> tier_workers_;
-  std::vector<std::thread> local_workers_;
+  std::unique_ptr<AttemptExecutor> executor_;
   std::thread scheduler_thread_;
   std::thread monitor_thread_;
 
-  std::vector<WorkflowMetrics> workflow_metrics_;
+  std::vector<AttemptResult> result_batch_;  // ProcessResults scratch, reused across calls
+
+  // Per-run distributions live in fixed-memory histograms updated as each
+  // workflow finishes, and a binary workflows.bin record is appended at the
+  // same moment, so metrics memory is O(1) in total workflow count. The CSV
+  // rendering happens offline via --convert.
+  HdrHistogram makespan_hist_{1.0};
+  HdrHistogram cost_hist_{1000.0};  // costs are ~unit scale; bucket in milli-units
+  std::unique_ptr<MappedFile> workflows_bin_;
+  double last_summary_write_ms_ = 0.0;
+  // Simulator-overhead profile, dumped as perf.csv next to summary.csv.
+  PerfCounters perf_;
   SummaryMetrics summary_metrics_;
-  std::mutex workflows_mutex_;
   std::chrono::steady_clock::time_point run_start_;
+
+  // Event-driven scheduler wakeup: ProcessResults notifies after handling
+  // completions so dispatch runs immediately; scheduler_interval_ms remains
+  // only as a fallback timer.
+  std::mutex scheduler_wake_mutex_;
+  std::condition_variable scheduler_wake_cv_;
+  bool scheduler_wake_pending_ = false;
+  bool des_dispatch_pending_ = false;
 };
 
 }  // namespace sim
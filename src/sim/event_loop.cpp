@@ -0,0 +1,29 @@
+#include "sim/event_loop.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace sim {
+
+void EventLoop::Schedule(double at_ms, Callback cb) {
+  Event ev;
+  ev.at_ms = std::max(at_ms, now_ms_);
+  ev.seq = next_seq_++;
+  ev.cb = std::move(cb);
+  heap_.push(std::move(ev));
+}
+
+void EventLoop::ScheduleAfter(double delay_ms, Callback cb) {
+  Schedule(now_ms_ + std::max(0.0, delay_ms), std::move(cb));
+}
+
+bool EventLoop::RunOne() {
+  if (heap_.empty()) return false;
+  Event ev = heap_.top();
+  heap_.pop();
+  now_ms_ = ev.at_ms;
+  ev.cb();
+  return true;
+}
+
+}  // namespace sim
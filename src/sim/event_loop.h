@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <vector>
+
+namespace sim {
+
+// Minimal discrete-event loop: a virtual clock plus a time-ordered queue of
+// callbacks. Events scheduled for the same timestamp run in scheduling order,
+// which keeps runs deterministic for a fixed seed.
+class EventLoop {
+ public:
+  using Callback = std::function<void()>;
+
+  double now_ms() const { return now_ms_; }
+  bool empty() const { return heap_.empty(); }
+
+  // Schedules cb at absolute virtual time at_ms. Times in the past are clamped
+  // to the current clock so callers cannot rewind the simulation.
+  void Schedule(double at_ms, Callback cb);
+  void ScheduleAfter(double delay_ms, Callback cb);
+
+  // Pops the earliest event, advances the clock to it, and runs it.
+  // Returns false if the queue is empty.
+  bool RunOne();
+
+ private:
+  struct Event {
+    double at_ms = 0.0;
+    std::uint64_t seq = 0;
+    Callback cb;
+  };
+  struct Later {
+    bool operator()(const Event& a, const Event& b) const {
+      if (a.at_ms != b.at_ms) return a.at_ms > b.at_ms;
+      return a.seq > b.seq;
+    }
+  };
+
+  double now_ms_ = 0.0;
+  std::uint64_t next_seq_ = 0;
+  std::priority_queue<Event, std::vector<Event>, Later> heap_;
+};
+
+}  // namespace sim
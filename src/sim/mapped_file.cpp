@@ -0,0 +1,69 @@
+#include "sim/mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <stdexcept>
+
+namespace sim {
+
+// Growth step. Large enough that a typical run remaps a handful of times;
+// the excess is trimmed on Close so small runs do not leave 4 MiB files.
+static constexpr std::size_t kChunkBytes = std::size_t{4} << 20;
+
+MappedFile::MappedFile(const std::string& path) : path_(path) {
+  fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0) {
+    throw std::runtime_error("MappedFile: cannot open " + path_);
+  }
+  Remap(kChunkBytes);
+}
+
+MappedFile::~MappedFile() {
+  Close();
+}
+
+void MappedFile::Remap(std::size_t new_capacity) {
+  if (base_) {
+    ::munmap(base_, capacity_);
+    base_ = nullptr;
+  }
+  if (::ftruncate(fd_, static_cast<off_t>(new_capacity)) != 0) {
+    throw std::runtime_error("MappedFile: ftruncate failed for " + path_);
+  }
+  void* p = ::mmap(nullptr, new_capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (p == MAP_FAILED) {
+    throw std::runtime_error("MappedFile: mmap failed for " + path_);
+  }
+  base_ = static_cast<char*>(p);
+  capacity_ = new_capacity;
+}
+
+void MappedFile::Append(const void* data, std::size_t size) {
+  if (fd_ < 0) {
+    throw std::runtime_error("MappedFile: append after close: " + path_);
+  }
+  if (used_ + size > capacity_) {
+    std::size_t cap = capacity_;
+    while (used_ + size > cap) cap += kChunkBytes;
+    Remap(cap);
+  }
+  std::memcpy(base_ + used_, data, size);
+  used_ += size;
+}
+
+void MappedFile::Close() {
+  if (fd_ < 0) return;
+  if (base_) {
+    ::munmap(base_, capacity_);
+    base_ = nullptr;
+  }
+  // Best effort: Close runs from the destructor and must not throw.
+  static_cast<void>(::ftruncate(fd_, static_cast<off_t>(used_)));
+  ::close(fd_);
+  fd_ = -1;
+}
+
+}  // namespace sim
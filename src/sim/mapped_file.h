@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace sim {
+
+// Append-only output file backed by a shared memory mapping. The file is
+// pre-extended in large chunks (ftruncate + remap on growth) and trimmed to
+// the bytes actually written on Close, so an append is a bounds check and a
+// memcpy into the page cache -- persistence cost is kernel writeback, not
+// per-record write() calls or iostream formatting.
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  void Append(const void* data, std::size_t size);
+
+  // Trims the file to its written length and unmaps. Idempotent; called
+  // automatically by the destructor.
+  void Close();
+
+  std::size_t bytes_written() const { return used_; }
+
+ private:
+  void Remap(std::size_t new_capacity);
+
+  std::string path_;  // for error messages
+  int fd_ = -1;
+  char* base_ = nullptr;
+  std::size_t capacity_ = 0;
+  std::size_t used_ = 0;
+};
+
+}  // namespace sim
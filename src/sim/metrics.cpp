@@ -1,86 +1,297 @@
 #include "sim/metrics.h"
 
+#include "sim/snapshot.h"
+
 #include <algorithm>
+#include <bit>
 #include <cmath>
+#include <cstring>
 #include <fstream>
 #include <sstream>
+#include <stdexcept>
 
 namespace sim {
 
-QuantileEstimator::QuantileEstimator(std::size_t max_samples) : max_samples_(max_samples) {}
+P2Quantile::P2Quantile(double quantile) : quantile_(quantile) {
+  desired_ = {1.0, 1.0 + 2.0 * quantile, 1.0 + 4.0 * quantile, 3.0 + 2.0 * quantile, 5.0};
+  increments_ = {0.0, quantile / 2.0, quantile, (1.0 + quantile) / 2.0, 1.0};
+}
+
+void P2Quantile::Add(double value) {
+  if (count_ < 5) {
+    heights_[count_++] = value;
+    if (count_ == 5) {
+      std::sort(heights_.begin(), heights_.end());
+      for (std::size_t i = 0; i < 5; ++i) positions_[i] = static_cast<double>(i + 1);
+    }
+    return;
+  }
+
+  // Locate the cell the observation falls into, extending the extremes.
+  std::size_t k;
+  if (value < heights_[0]) {
+    heights_[0] = value;
+    k = 0;
+  } else if (value >= heights_[4]) {
+    heights_[4] = value;
+    k = 3;
+  } else {
+    k = 0;
+    while (k < 3 && value >= heights_[k + 1]) ++k;
+  }
+
+  for (std::size_t i = k + 1; i < 5; ++i) positions_[i] += 1.0;
+  for (std::size_t i = 0; i < 5; ++i) desired_[i] += increments_[i];
+  ++count_;
+
+  // Nudge the three interior markers toward their desired positions, using
+  // parabolic interpolation when it keeps the heights ordered.
+  for (std::size_t i = 1; i <= 3; ++i) {
+    const double d = desired_[i] - positions_[i];
+    const double gap_up = positions_[i + 1] - positions_[i];
+    const double gap_down = positions_[i - 1] - positions_[i];
+    if ((d >= 1.0 && gap_up > 1.0) || (d <= -1.0 && gap_down < -1.0)) {
+      const double s = d >= 1.0 ? 1.0 : -1.0;
+      const double span = positions_[i + 1] - positions_[i - 1];
+      double h = heights_[i] +
+                 s / span *
+                     ((positions_[i] - positions_[i - 1] + s) * (heights_[i + 1] - heights_[i]) /
+                          gap_up +
+                      (positions_[i + 1] - positions_[i] - s) * (heights_[i] - heights_[i - 1]) /
+                          (positions_[i] - positions_[i - 1]));
+      if (h <= heights_[i - 1] || h >= heights_[i + 1]) {
+        const std::size_t j = s > 0.0 ? i + 1 : i - 1;
+        h = heights_[i] + s * (heights_[j] - heights_[i]) / (positions_[j] - positions_[i]);
+      }
+      heights_[i] = h;
+      positions_[i] += s;
+    }
+  }
+}
+
+double P2Quantile::Value() const {
+  if (count_ >= 5) return heights_[2];
+  if (count_ == 0) return 0.0;
+  std::array<double, 5> sorted = heights_;
+  std::sort(sorted.begin(), sorted.begin() + static_cast<std::ptrdiff_t>(count_));
+  const std::size_t idx = static_cast<std::size_t>(quantile_ * static_cast<double>(count_));
+  return sorted[std::min(idx, count_ - 1)];
+}
+
+QuantileEstimator::QuantileEstimator() : p50_(0.50), p90_(0.90), p95_(0.95) {}
 
 void QuantileEstimator::Add(double value) {
-  samples_.push_back(value);
-  if (samples_.size() > max_samples_) samples_.pop_front();
+  p50_.Add(value);
+  p90_.Add(value);
+  p95_.Add(value);
 }
 
 double QuantileEstimator::P50() const {
-  if (samples_.empty()) return 100.0;
-  sorted_.assign(samples_.begin(), samples_.end());
-  std::sort(sorted_.begin(), sorted_.end());
-  const std::size_t idx = static_cast<std::size_t>(0.50 * static_cast<double>(sorted_.size()));
-  return sorted_[std::min(idx, sorted_.size() - 1)];
+  if (p50_.Count() == 0) return 100.0;
+  return p50_.Value();
 }
 
 double QuantileEstimator::P90() const {
-  if (samples_.empty()) return 200.0;
-  sorted_.assign(samples_.begin(), samples_.end());
-  std::sort(sorted_.begin(), sorted_.end());
-  const std::size_t idx = static_cast<std::size_t>(0.90 * static_cast<double>(sorted_.size()));
-  return sorted_[std::min(idx, sorted_.size() - 1)];
+  if (p90_.Count() == 0) return 200.0;
+  return p90_.Value();
 }
 
 double QuantileEstimator::P95() const {
-  if (samples_.empty()) return 300.0;
-  sorted_.assign(samples_.begin(), samples_.end());
-  std::sort(sorted_.begin(), sorted_.end());
-  const std::size_t idx = static_cast<std::size_t>(0.95 * static_cast<double>(sorted_.size()));
-  return sorted_[std::min(idx, sorted_.size() - 1)];
+  if (p95_.Count() == 0) return 300.0;
+  return p95_.Value();
 }
 
-std::size_t LatencyEstKeyHash::operator()(const LatencyEstKey& k) const {
-  std::size_t h = static_cast<std::size_t>(k.node_type) * 31;
-  h ^= std::hash<std::string>{}(k.provider);
-  h = h * 31 + static_cast<std::size_t>(k.tier_id);
-  return h;
+std::size_t LatencyEstimateStore::WaitSlot(ProviderId provider_id, int tier_id) {
+  const std::size_t p = static_cast<std::size_t>(provider_id);
+  const std::size_t t = static_cast<std::size_t>(tier_id);
+  if (p >= kMaxProviders || t >= kMaxTiers) {
+    throw std::runtime_error("LatencyEstimateStore: provider/tier out of dense range");
+  }
+  return p * kMaxTiers + t;
 }
 
-void LatencyEstimateStore::Record(NodeType type, const std::string& provider, int tier_id,
+std::size_t LatencyEstimateStore::Slot(NodeType type, ProviderId provider_id, int tier_id) {
+  return WaitSlot(provider_id, tier_id) * kNumNodeTypes + static_cast<std::size_t>(type);
+}
+
+void LatencyEstimateStore::Record(NodeType type, ProviderId provider_id, int tier_id,
                                   double duration_ms) {
-  std::lock_guard lock(mutex_);
-  LatencyEstKey key{type, provider, tier_id};
-  by_key_[key].Add(duration_ms);
+  const std::size_t slot = Slot(type, provider_id, tier_id);
+  std::lock_guard lock(stripe_mutex_[slot % kNumStripes]);
+  by_key_[slot].Add(duration_ms);
+}
+
+double LatencyEstimateStore::GetP50(NodeType type, ProviderId provider_id, int tier_id) const {
+  const std::size_t slot = Slot(type, provider_id, tier_id);
+  std::lock_guard lock(stripe_mutex_[slot % kNumStripes]);
+  if (by_key_[slot].Count() == 0) return 100.0;
+  return by_key_[slot].P50();
+}
+
+double LatencyEstimateStore::GetP95(NodeType type, ProviderId provider_id, int tier_id) const {
+  const std::size_t slot = Slot(type, provider_id, tier_id);
+  std::lock_guard lock(stripe_mutex_[slot % kNumStripes]);
+  if (by_key_[slot].Count() == 0) return 300.0;
+  return by_key_[slot].P95();
+}
+
+void LatencyEstimateStore::RecordQueueWait(ProviderId provider_id, int tier_id, double wait_ms) {
+  const std::size_t slot = WaitSlot(provider_id, tier_id);
+  std::lock_guard lock(stripe_mutex_[slot % kNumStripes]);
+  queue_wait_[slot].Add(wait_ms);
+}
+
+double LatencyEstimateStore::GetP95QueueWait(ProviderId provider_id, int tier_id) const {
+  const std::size_t slot = WaitSlot(provider_id, tier_id);
+  std::lock_guard lock(stripe_mutex_[slot % kNumStripes]);
+  if (queue_wait_[slot].Count() == 0) return 50.0;
+  return queue_wait_[slot].P95();
+}
+
+// ----------------------------------------------------------------------------
+// Snapshot support
+// ----------------------------------------------------------------------------
+
+void P2Quantile::SaveTo(std::ostream& out) const {
+  snap::Write(out, static_cast<std::uint64_t>(count_));
+  for (double h : heights_) snap::Write(out, h);
+  for (double p : positions_) snap::Write(out, p);
+  for (double d : desired_) snap::Write(out, d);
+}
+
+void P2Quantile::LoadFrom(std::istream& in) {
+  count_ = static_cast<std::size_t>(snap::Read<std::uint64_t>(in));
+  for (double& h : heights_) h = snap::Read<double>(in);
+  for (double& p : positions_) p = snap::Read<double>(in);
+  for (double& d : desired_) d = snap::Read<double>(in);
 }
 
-double LatencyEstimateStore::GetP50(NodeType type, const std::string& provider, int tier_id) const {
-  std::lock_guard lock(mutex_);
-  LatencyEstKey key{type, provider, tier_id};
-  auto it = by_key_.find(key);
-  if (it == by_key_.end()) return 100.0;
-  return it->second.P50();
+void QuantileEstimator::SaveTo(std::ostream& out) const {
+  p50_.SaveTo(out);
+  p90_.SaveTo(out);
+  p95_.SaveTo(out);
 }
 
-double LatencyEstimateStore::GetP95(NodeType type, const std::string& provider, int tier_id) const {
-  std::lock_guard lock(mutex_);
-  LatencyEstKey key{type, provider, tier_id};
-  auto it = by_key_.find(key);
-  if (it == by_key_.end()) return 300.0;
-  return it->second.P95();
+void QuantileEstimator::LoadFrom(std::istream& in) {
+  p50_.LoadFrom(in);
+  p90_.LoadFrom(in);
+  p95_.LoadFrom(in);
 }
 
-void LatencyEstimateStore::RecordQueueWait(const std::string& provider, int tier_id,
-                                          double wait_ms) {
-  std::lock_guard lock(mutex_);
-  queue_wait_[provider][tier_id].Add(wait_ms);
+void LatencyEstimateStore::SaveTo(std::ostream& out) const {
+  // Provider ids are assigned deterministically at config load, so slot
+  // indices are stable across runs of the same workload.
+  std::uint64_t by_key_total = 0;
+  std::uint64_t queue_wait_total = 0;
+  for (const QuantileEstimator& est : by_key_) by_key_total += (est.Count() > 0) ? 1 : 0;
+  for (const QuantileEstimator& est : queue_wait_) queue_wait_total += (est.Count() > 0) ? 1 : 0;
+
+  snap::Write(out, by_key_total);
+  for (std::size_t slot = 0; slot < by_key_.size(); ++slot) {
+    if (by_key_[slot].Count() == 0) continue;
+    snap::Write(out, static_cast<std::uint32_t>(slot));
+    by_key_[slot].SaveTo(out);
+  }
+  snap::Write(out, queue_wait_total);
+  for (std::size_t slot = 0; slot < queue_wait_.size(); ++slot) {
+    if (queue_wait_[slot].Count() == 0) continue;
+    snap::Write(out, static_cast<std::uint32_t>(slot));
+    queue_wait_[slot].SaveTo(out);
+  }
+}
+
+void LatencyEstimateStore::LoadFrom(std::istream& in) {
+  const auto by_key_total = snap::Read<std::uint64_t>(in);
+  for (std::uint64_t i = 0; i < by_key_total; ++i) {
+    const auto slot = snap::Read<std::uint32_t>(in);
+    if (slot >= by_key_.size()) {
+      throw std::runtime_error("Snapshot: latency estimate slot out of range");
+    }
+    by_key_[slot].LoadFrom(in);
+  }
+  const auto queue_wait_total = snap::Read<std::uint64_t>(in);
+  for (std::uint64_t i = 0; i < queue_wait_total; ++i) {
+    const auto slot = snap::Read<std::uint32_t>(in);
+    if (slot >= queue_wait_.size()) {
+      throw std::runtime_error("Snapshot: queue wait slot out of range");
+    }
+    queue_wait_[slot].LoadFrom(in);
+  }
+}
+
+HdrHistogram::HdrHistogram(double unit_scale) : unit_scale_(unit_scale) {}
+
+std::size_t HdrHistogram::IndexFor(std::uint64_t v) {
+  constexpr std::uint64_t kMax =
+      (std::uint64_t{1} << (kBucketCount - 1 + kSubBucketBits)) - 1;
+  if (v > kMax) v = kMax;
+  // Bucket 0 holds [0, 64) exactly; bucket b >= 1 holds [64 * 2^(b-1),
+  // 64 * 2^b) with the top 32 sub-buckets populated (the bottom half aliases
+  // the previous bucket).
+  const int msb = 63 - std::countl_zero(v | (kSubBucketCount - 1));
+  const int bucket = msb - (kSubBucketBits - 1);
+  if (bucket == 0) return static_cast<std::size_t>(v);
+  return kSubBucketCount + static_cast<std::size_t>(bucket - 1) * kSubBucketHalf +
+         (static_cast<std::size_t>(v >> bucket) - kSubBucketHalf);
+}
+
+std::uint64_t HdrHistogram::UpperEdge(std::size_t index) {
+  if (index < kSubBucketCount) return static_cast<std::uint64_t>(index);
+  const std::size_t bucket = (index - kSubBucketCount) / kSubBucketHalf + 1;
+  const std::size_t sub = (index - kSubBucketCount) % kSubBucketHalf + kSubBucketHalf;
+  return (static_cast<std::uint64_t>(sub + 1) << bucket) - 1;
+}
+
+void HdrHistogram::Record(double value) {
+  if (value < 0.0) value = 0.0;
+  ++counts_[IndexFor(static_cast<std::uint64_t>(value * unit_scale_))];
+  ++count_;
+  sum_ += value;
 }
 
-double LatencyEstimateStore::GetP95QueueWait(const std::string& provider, int tier_id) const {
-  std::lock_guard lock(mutex_);
-  auto pit = queue_wait_.find(provider);
-  if (pit == queue_wait_.end()) return 50.0;
-  auto tit = pit->second.find(tier_id);
-  if (tit == pit->second.end()) return 50.0;
-  return tit->second.P95();
+double HdrHistogram::Mean() const {
+  return count_ > 0 ? sum_ / static_cast<double>(count_) : 0.0;
+}
+
+double HdrHistogram::Percentile(double pct) const {
+  if (count_ == 0) return 0.0;
+  const auto target =
+      static_cast<std::uint64_t>(std::ceil(pct / 100.0 * static_cast<double>(count_)));
+  std::uint64_t seen = 0;
+  for (std::size_t i = 0; i < counts_.size(); ++i) {
+    seen += counts_[i];
+    if (seen >= target && counts_[i] > 0) {
+      return static_cast<double>(UpperEdge(i)) / unit_scale_;
+    }
+  }
+  return static_cast<double>(UpperEdge(counts_.size() - 1)) / unit_scale_;
+}
+
+void HdrHistogram::SaveTo(std::ostream& out) const {
+  snap::Write(out, count_);
+  snap::Write(out, sum_);
+  std::uint64_t nonzero = 0;
+  for (std::uint64_t c : counts_) nonzero += (c != 0) ? 1 : 0;
+  snap::Write(out, nonzero);
+  for (std::size_t i = 0; i < counts_.size(); ++i) {
+    if (counts_[i] == 0) continue;
+    snap::Write(out, static_cast<std::uint32_t>(i));
+    snap::Write(out, counts_[i]);
+  }
+}
+
+void HdrHistogram::LoadFrom(std::istream& in) {
+  count_ = snap::Read<std::size_t>(in);
+  sum_ = snap::Read<double>(in);
+  counts_.fill(0);
+  const auto nonzero = snap::Read<std::uint64_t>(in);
+  for (std::uint64_t i = 0; i < nonzero; ++i) {
+    const auto idx = snap::Read<std::uint32_t>(in);
+    if (idx >= counts_.size()) {
+      throw std::runtime_error("Snapshot: histogram bucket index out of range");
+    }
+    counts_[idx] = snap::Read<std::uint64_t>(in);
+  }
 }
 
 static void WriteCsv(const std::string& path, const std::vector<std::string>& headers,
@@ -101,47 +312,55 @@ static void WriteCsv(const std::string& path, const std::vector<std::string>& he
   }
 }
 
-void WriteWorkflowsCsv(const std::string& out_dir, const std::vector<WorkflowMetrics>& metrics) {
-  std::vector<std::string> headers = {"workflow_id", "makespan_ms", "cost", "retries",
-                                     "cancellations", "hedges_launched", "wasted_ms"};
-  std::vector<std::vector<std::string>> rows;
-  for (const auto& m : metrics) {
-    std::ostringstream ms, c, w;
-    ms << m.makespan_ms;
-    c << m.cost;
-    w << m.wasted_ms;
-    rows.push_back({std::to_string(m.workflow_id), ms.str(), c.str(), std::to_string(m.retries),
-                    std::to_string(m.cancellations), std::to_string(m.hedges_launched), w.str()});
+void ConvertWorkflowsToCsv(const std::string& bin_path, std::ostream& out) {
+  std::ifstream in(bin_path, std::ios::binary);
+  if (!in) {
+    throw std::runtime_error("ConvertWorkflowsToCsv: cannot open " + bin_path);
+  }
+  WorkflowFileHeader header;
+  in.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!in || std::memcmp(header.magic, "ASWF", 4) != 0 || header.version != 2 ||
+      header.record_size != sizeof(WorkflowRecord)) {
+    throw std::runtime_error("ConvertWorkflowsToCsv: incompatible file " + bin_path);
+  }
+
+  out << "workflow_id,makespan_ms,cost,retries,cancellations,hedges_launched,wasted_ms\n";
+  WorkflowRecord rec;
+  while (in.read(reinterpret_cast<char*>(&rec), sizeof(rec))) {
+    out << rec.workflow_id << ',' << rec.makespan_ms << ',' << rec.cost << ',' << rec.retries
+        << ',' << rec.cancellations << ',' << rec.hedges_launched << ',' << rec.wasted_ms
+        << '\n';
   }
-  WriteCsv(out_dir + "/workflows.csv", headers, rows);
 }
 
 void WriteTiersCsv(const std::string& out_dir, const std::vector<TierStats>& stats) {
   std::vector<std::string> headers = {"provider", "tier_id", "utilization", "queue_wait_p95_ms",
-                                      "in_flight_avg"};
+                                      "in_flight_avg", "queue_depth"};
   std::vector<std::vector<std::string>> rows;
   for (const auto& s : stats) {
     std::ostringstream u, q;
     u << s.utilization;
     q << s.queue_wait_p95_ms;
     rows.push_back({s.provider, std::to_string(s.tier_id), u.str(), q.str(),
-                    std::to_string(s.in_flight_avg)});
+                    std::to_string(s.in_flight_avg), std::to_string(s.queue_depth)});
   }
   WriteCsv(out_dir + "/tiers.csv", headers, rows);
 }
 
 void WriteSummaryCsv(const std::string& out_dir, const SummaryMetrics& summary) {
   std::vector<std::string> headers = {"makespan_mean_ms", "makespan_p50_ms", "makespan_p95_ms",
-                                     "makespan_p99_ms", "cost_mean", "cost_p50"};
-  std::ostringstream m1, m2, m3, m4, c1, c2;
+                                     "makespan_p99_ms", "cost_mean", "cost_p50",
+                                     "throughput_wps"};
+  std::ostringstream m1, m2, m3, m4, c1, c2, tp;
   m1 << summary.makespan_mean_ms;
   m2 << summary.makespan_p50_ms;
   m3 << summary.makespan_p95_ms;
   m4 << summary.makespan_p99_ms;
   c1 << summary.cost_mean;
   c2 << summary.cost_p50;
+  tp << summary.throughput_wps;
   std::vector<std::vector<std::string>> rows = {
-      {m1.str(), m2.str(), m3.str(), m4.str(), c1.str(), c2.str()}};
+      {m1.str(), m2.str(), m3.str(), m4.str(), c1.str(), c2.str(), tp.str()}};
   WriteCsv(out_dir + "/summary.csv", headers, rows);
 }
 
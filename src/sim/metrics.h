@@ -2,72 +2,160 @@
 
 #include "sim/types.h"
 
+#include <array>
 #include <chrono>
-#include <deque>
+#include <iosfwd>
 #include <mutex>
 #include <string>
-#include <unordered_map>
 #include <vector>
 
 namespace sim {
 
-// Rolling quantile estimator: keeps recent samples, computes approximate p50/p90/p95.
+// Single-quantile P-square estimator (Jain & Chlamtac): five markers nudged
+// toward the target quantile by parabolic interpolation. O(1) per sample and
+// per query, no stored samples.
+class P2Quantile {
+ public:
+  explicit P2Quantile(double quantile);
+
+  void Add(double value);
+  double Value() const;
+  std::size_t Count() const { return count_; }
+
+  // Snapshot support: marker state only; the target quantile and increments
+  // come from construction.
+  void SaveTo(std::ostream& out) const;
+  void LoadFrom(std::istream& in);
+
+ private:
+  double quantile_;
+  std::size_t count_ = 0;
+  std::array<double, 5> heights_{};
+  std::array<double, 5> positions_{};
+  std::array<double, 5> desired_{};
+  std::array<double, 5> increments_{};
+};
+
+// Streaming quantile estimator: approximate p50/p90/p95 in constant time per
+// sample and per query.
 class QuantileEstimator {
  public:
-  explicit QuantileEstimator(std::size_t max_samples = 1000);
+  QuantileEstimator();
 
   void Add(double value);
   double P50() const;
   double P90() const;
   double P95() const;
-  std::size_t Count() const { return samples_.size(); }
+  std::size_t Count() const { return p50_.Count(); }
+
+  void SaveTo(std::ostream& out) const;
+  void LoadFrom(std::istream& in);
 
  private:
-  std::deque<double> samples_;
-  std::size_t max_samples_;
-  mutable std::vector<double> sorted_;
+  P2Quantile p50_;
+  P2Quantile p90_;
+  P2Quantile p95_;
 };
 
-// Key for (node_type, provider, tier_id) latency estimates.
-struct LatencyEstKey {
-  NodeType node_type;
-  std::string provider;
-  int tier_id = 0;
+// Thread-safe store of latency estimates per (type, provider, tier). The
+// key space is the product of three small interned/enum ranges, so estimators
+// live in dense arrays indexed by slot -- a lookup is arithmetic plus a
+// striped mutex, with no hashing or allocation. Locks are striped by slot so
+// the scheduler's per-node lookups and the result path's inserts rarely
+// contend on the same mutex.
+class LatencyEstimateStore {
+ public:
+  void Record(NodeType type, ProviderId provider_id, int tier_id, double duration_ms);
+  double GetP50(NodeType type, ProviderId provider_id, int tier_id) const;
+  double GetP95(NodeType type, ProviderId provider_id, int tier_id) const;
+  double GetP95QueueWait(ProviderId provider_id, int tier_id) const;
+  void RecordQueueWait(ProviderId provider_id, int tier_id, double wait_ms);
 
-  bool operator==(const LatencyEstKey& o) const {
-    return node_type == o.node_type && provider == o.provider && tier_id == o.tier_id;
-  }
-};
+  // Snapshot support: non-empty slots are written flat by slot index, so the
+  // on-disk form does not depend on the stripe layout.
+  void SaveTo(std::ostream& out) const;
+  void LoadFrom(std::istream& in);
 
-struct LatencyEstKeyHash {
-  std::size_t operator()(const LatencyEstKey& k) const;
+ private:
+  static constexpr std::size_t kNumStripes = 8;
+  static constexpr std::size_t kMaxProviders = 8;
+  static constexpr std::size_t kMaxTiers = 4;  // matches ProviderManager's dense table
+  static constexpr std::size_t kNumNodeTypes = 8;
+  static constexpr std::size_t kNumSlots = kMaxProviders * kMaxTiers * kNumNodeTypes;
+  static constexpr std::size_t kNumWaitSlots = kMaxProviders * kMaxTiers;
+
+  static std::size_t WaitSlot(ProviderId provider_id, int tier_id);
+  static std::size_t Slot(NodeType type, ProviderId provider_id, int tier_id);
+
+  mutable std::array<std::mutex, kNumStripes> stripe_mutex_;
+  std::array<QuantileEstimator, kNumSlots> by_key_;
+  std::array<QuantileEstimator, kNumWaitSlots> queue_wait_;
 };
 
-// Thread-safe store of latency estimates per (type, tier).
-class LatencyEstimateStore {
+// Fixed-memory log-linear histogram (HdrHistogram-style): values land in
+// power-of-two ranges split into 64 linear sub-buckets (~1.6% relative
+// error), so recording is one array increment and the footprint is constant
+// no matter how many samples arrive. unit_scale multiplies values before
+// integer bucketing; record small magnitudes (e.g. dollar costs) with a
+// scale that keeps the digits that matter above 1.
+class HdrHistogram {
  public:
-  void Record(NodeType type, const std::string& provider, int tier_id, double duration_ms);
-  double GetP50(NodeType type, const std::string& provider, int tier_id) const;
-  double GetP95(NodeType type, const std::string& provider, int tier_id) const;
-  double GetP95QueueWait(const std::string& provider, int tier_id) const;
-  void RecordQueueWait(const std::string& provider, int tier_id, double wait_ms);
+  explicit HdrHistogram(double unit_scale = 1.0);
+
+  void Record(double value);
+  std::size_t Count() const { return count_; }
+  double Mean() const;
+  // pct in [0, 100]; returns the upper edge of the bucket holding that rank.
+  double Percentile(double pct) const;
+
+  // Snapshot support: non-empty buckets only, plus count and exact sum.
+  void SaveTo(std::ostream& out) const;
+  void LoadFrom(std::istream& in);
 
  private:
-  mutable std::mutex mutex_;
-  std::unordered_map<LatencyEstKey, QuantileEstimator, LatencyEstKeyHash> by_key_;
-  std::unordered_map<std::string, std::unordered_map<int, QuantileEstimator>> queue_wait_;
+  static constexpr int kSubBucketBits = 6;
+  static constexpr std::size_t kSubBucketCount = std::size_t{1} << kSubBucketBits;
+  static constexpr std::size_t kSubBucketHalf = kSubBucketCount / 2;
+  static constexpr int kBucketCount = 41;  // covers [0, 2^46) scaled units
+  static constexpr std::size_t kTotalBuckets =
+      kSubBucketCount + (kBucketCount - 1) * kSubBucketHalf;
+
+  static std::size_t IndexFor(std::uint64_t v);
+  static std::uint64_t UpperEdge(std::size_t index);
+
+  double unit_scale_;
+  std::size_t count_ = 0;
+  double sum_ = 0.0;
+  std::array<std::uint64_t, kTotalBuckets> counts_{};
 };
 
-// Per-workflow metrics for CSV output.
-struct WorkflowMetrics {
+// Fixed-width per-workflow record appended to workflows.bin as each workflow
+// completes; the --convert subcommand renders workflows.csv from it offline.
+// wasted_ms is service time spent on attempts that did not resolve their
+// node: retried failures, permanent failures, and cancelled hedge losers.
+struct WorkflowRecord {
   WorkflowId workflow_id = 0;
+  std::int32_t retries = 0;
+  std::int32_t cancellations = 0;
+  std::int32_t hedges_launched = 0;
   double makespan_ms = 0.0;
   double cost = 0.0;
-  int retries = 0;
-  int cancellations = 0;
-  int hedges_launched = 0;
   double wasted_ms = 0.0;
 };
+static_assert(sizeof(WorkflowRecord) == 40, "WorkflowRecord must stay fixed-size");
+
+// Header at the start of workflows.bin, mirroring TraceFileHeader, so the
+// converter can reject files written by an incompatible build.
+struct WorkflowFileHeader {
+  char magic[4] = {'A', 'S', 'W', 'F'};
+  std::uint32_t version = 2;  // v2: per-workflow retry/cancel/hedge counters
+  std::uint32_t record_size = sizeof(WorkflowRecord);
+};
+
+// Reads a workflows.bin produced by the controller and writes the CSV the
+// run used to emit directly. Throws std::runtime_error if the file is
+// missing or incompatible.
+void ConvertWorkflowsToCsv(const std::string& bin_path, std::ostream& out);
 
 // Per-tier stats over a time window.
 struct TierStats {
@@ -76,6 +164,7 @@ struct TierStats {
   double utilization = 0.0;
   double queue_wait_p95_ms = 0.0;
   int in_flight_avg = 0;
+  int queue_depth = 0;  // backlog at the end of the run; nonzero means backpressure engaged
 };
 
 // Aggregate summary.
@@ -86,10 +175,12 @@ struct SummaryMetrics {
   double makespan_p99_ms = 0.0;
   double cost_mean = 0.0;
   double cost_p50 = 0.0;
+  // Completed workflows per second over the measurement window (warm-up end
+  // to run end); the saturation signal for open-loop load sweeps.
+  double throughput_wps = 0.0;
 };
 
 // Writes CSV files to out_dir.
-void WriteWorkflowsCsv(const std::string& out_dir, const std::vector<WorkflowMetrics>& metrics);
 void WriteTiersCsv(const std::string& out_dir, const std::vector<TierStats>& stats);
 void WriteSummaryCsv(const std::string& out_dir, const SummaryMetrics& summary);
 
@@ -0,0 +1,34 @@
+#include "sim/perf.h"
+
+#include <fstream>
+
+namespace sim {
+
+const char* PerfPhaseName(PerfPhase phase) {
+  switch (phase) {
+    case PerfPhase::dispatch_total: return "dispatch_total";
+    case PerfPhase::score_pass: return "score_pass";
+    case PerfPhase::selection_sort: return "selection_sort";
+    case PerfPhase::dispatch_loop: return "dispatch_loop";
+    case PerfPhase::rem_cp_rebuild: return "rem_cp_rebuild";
+    case PerfPhase::shard_lock_wait: return "shard_lock_wait";
+    case PerfPhase::process_results: return "process_results";
+    case PerfPhase::monitor_scan: return "monitor_scan";
+  }
+  return "unknown";
+}
+
+void PerfCounters::WriteCsv(const std::string& out_dir) const {
+  std::ofstream out(out_dir + "/perf.csv");
+  out << "phase,calls,total_ms,mean_us\n";
+  for (std::size_t i = 0; i < kNumPerfPhases; ++i) {
+    const auto calls = cells_[i].calls.load(std::memory_order_relaxed);
+    const auto ns = cells_[i].ns.load(std::memory_order_relaxed);
+    const double total_ms = static_cast<double>(ns) / 1e6;
+    const double mean_us = calls ? static_cast<double>(ns) / static_cast<double>(calls) / 1e3 : 0.0;
+    out << PerfPhaseName(static_cast<PerfPhase>(i)) << ',' << calls << ',' << total_ms << ','
+        << mean_us << '\n';
+  }
+}
+
+}  // namespace sim
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace sim {
+
+// Simulator-overhead phases tracked by the always-on self-profiler. These
+// cover where simulator (not simulated) time goes: scheduler scoring and
+// selection, shard lock acquisition, result processing, and the straggler
+// monitor. Nested phases overlap their parents (dispatch_total contains
+// score_pass, selection_sort, and dispatch_loop), so shares are computed
+// against the phase of interest, not the column sum.
+enum class PerfPhase {
+  dispatch_total,
+  score_pass,
+  selection_sort,
+  dispatch_loop,
+  rem_cp_rebuild,
+  shard_lock_wait,
+  process_results,
+  monitor_scan,
+};
+inline constexpr std::size_t kNumPerfPhases = 8;
+
+const char* PerfPhaseName(PerfPhase phase);
+
+// Wall-time accumulators per phase, padded to a cache line apiece so
+// concurrent scoring workers and the controller thread do not false-share.
+// Recording is two relaxed fetch_adds; scopes are taken per tick or per
+// rebuild, never per node, so the profiler stays cheap enough to leave on.
+class PerfCounters {
+ public:
+  void Add(PerfPhase phase, std::uint64_t ns) {
+    Cell& cell = cells_[static_cast<std::size_t>(phase)];
+    cell.ns.fetch_add(ns, std::memory_order_relaxed);
+    cell.calls.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Writes out_dir/perf.csv: phase,calls,total_ms,mean_us.
+  void WriteCsv(const std::string& out_dir) const;
+
+ private:
+  struct alignas(64) Cell {
+    std::atomic<std::uint64_t> ns{0};
+    std::atomic<std::uint64_t> calls{0};
+  };
+  std::array<Cell, kNumPerfPhases> cells_;
+};
+
+// RAII scope accumulating its lifetime into one phase. Null counters make it
+// a no-op, so library code can be instrumented unconditionally.
+class PerfScope {
+ public:
+  PerfScope(PerfCounters* counters, PerfPhase phase)
+      : counters_(counters), phase_(phase),
+        start_(counters ? std::chrono::steady_clock::now()
+                        : std::chrono::steady_clock::time_point{}) {}
+  ~PerfScope() {
+    if (!counters_) return;
+    const auto end = std::chrono::steady_clock::now();
+    counters_->Add(phase_, static_cast<std::uint64_t>(
+                               std::chrono::duration_cast<std::chrono::nanoseconds>(end - start_)
+                                   .count()));
+  }
+
+  PerfScope(const PerfScope&) = delete;
+  PerfScope& operator=(const PerfScope&) = delete;
+
+ private:
+  PerfCounters* counters_;
+  PerfPhase phase_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace sim
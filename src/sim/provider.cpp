@@ -11,36 +11,79 @@ namespace sim {
 // -----------------------------------------------------------------------------
 
 TokenBucket::TokenBucket(double rate_per_sec, double capacity, double time_scale)
-    : rate_per_sec_(rate_per_sec), capacity_(capacity), tokens_(capacity),
+    : rate_per_sec_(rate_per_sec), capacity_(capacity),
       time_scale_(std::max(1.0, time_scale)),
-      last_refill_(std::chrono::steady_clock::now()) {
+      capacity_micro_(std::llround(capacity * static_cast<double>(kMicroPerToken))),
+      micro_per_ns_(rate_per_sec * time_scale_ * static_cast<double>(kMicroPerToken) / 1e9),
+      epoch_(std::chrono::steady_clock::now()),
+      tokens_micro_(capacity_micro_) {
   if (rate_per_sec <= 0.0 || capacity <= 0.0) {
     throw std::runtime_error("TokenBucket: rate and capacity must be positive");
   }
 }
 
+std::int64_t TokenBucket::NowNs() const {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                                                              epoch_)
+      .count();
+}
+
 void TokenBucket::Refill() {
-  const auto now = std::chrono::steady_clock::now();
-  const auto elapsed_wall = std::chrono::duration<double>(now - last_refill_).count();
-  const double elapsed = elapsed_wall * time_scale_;
-  tokens_ = std::min(capacity_, tokens_ + elapsed * rate_per_sec_);
-  last_refill_ = now;
+  const std::int64_t now = NowNs();
+  std::int64_t last = last_refill_ns_.load(std::memory_order_relaxed);
+  if (now <= last) return;
+  const auto add =
+      static_cast<std::int64_t>(static_cast<double>(now - last) * micro_per_ns_);
+  // Too little elapsed time to mint a micro-token: leave the timestamp alone
+  // so the fraction is not silently discarded.
+  if (add <= 0) return;
+  // One refiller claims the interval; losers re-observe elapsed time on their
+  // next attempt, so no credit is double-counted.
+  if (!last_refill_ns_.compare_exchange_strong(last, now, std::memory_order_acq_rel,
+                                               std::memory_order_relaxed)) {
+    return;
+  }
+  std::int64_t cur = tokens_micro_.load(std::memory_order_relaxed);
+  while (!tokens_micro_.compare_exchange_weak(cur, std::min(capacity_micro_, cur + add),
+                                              std::memory_order_acq_rel,
+                                              std::memory_order_relaxed)) {
+  }
+}
+
+bool TokenBucket::TryAcquireMicro(std::int64_t needed) {
+  std::int64_t cur = tokens_micro_.load(std::memory_order_relaxed);
+  while (cur >= needed) {
+    if (tokens_micro_.compare_exchange_weak(cur, cur - needed, std::memory_order_acq_rel,
+                                            std::memory_order_relaxed)) {
+      return true;
+    }
+  }
+  return false;
 }
 
 void TokenBucket::Acquire(double tokens) {
   if (tokens <= 0.0) return;
-  std::unique_lock lock(mutex_);
-  while (tokens_ < tokens) {
+  const std::int64_t needed = std::llround(tokens * static_cast<double>(kMicroPerToken));
+  while (true) {
+    if (TryAcquireMicro(needed)) return;  // fast path: no lock, no futex
     Refill();
-    if (tokens_ >= tokens) break;
-    const double effective_rate = rate_per_sec_ * time_scale_;
-    const double wait_sec = (tokens - tokens_) / effective_rate;
-    cv_.wait_for(lock, std::chrono::duration<double>(wait_sec), [this, tokens] {
-      Refill();
-      return tokens_ >= tokens;
-    });
+    if (TryAcquireMicro(needed)) return;
+    // Exhausted: sleep for roughly the time the deficit takes to refill. There
+    // is no notifier to wake us earlier -- tokens appear only with time -- so
+    // a plain timed sleep loses nothing over a condition variable.
+    const std::int64_t deficit =
+        std::max<std::int64_t>(1, needed - tokens_micro_.load(std::memory_order_relaxed));
+    const double wait_sec = static_cast<double>(deficit) / (micro_per_ns_ * 1e9);
+    std::this_thread::sleep_for(std::chrono::duration<double>(wait_sec));
   }
-  tokens_ -= tokens;
+}
+
+bool TokenBucket::TryAcquire(double tokens) {
+  if (tokens <= 0.0) return true;
+  const std::int64_t needed = std::llround(tokens * static_cast<double>(kMicroPerToken));
+  if (TryAcquireMicro(needed)) return true;
+  Refill();
+  return TryAcquireMicro(needed);
 }
 
 // -----------------------------------------------------------------------------
@@ -54,9 +97,53 @@ Tier::Tier(const TierConfig& config, double time_scale)
 void Tier::Enqueue(QueuedAttempt attempt) {
   {
     std::lock_guard lock(queue_mutex_);
-    queue_.push(std::move(attempt));
+    queue_.push_back(std::move(attempt));
+    std::push_heap(queue_.begin(), queue_.end(), &Tier::HeapLess);
+    queue_depth_.store(static_cast<int>(queue_.size()));
   }
   queue_cv_.notify_one();
+  if (enqueue_listener_) enqueue_listener_();
+}
+
+void Tier::EnqueueBatch(std::vector<QueuedAttempt>& attempts) {
+  if (attempts.empty()) return;
+  {
+    std::lock_guard lock(queue_mutex_);
+    for (QueuedAttempt& a : attempts) {
+      queue_.push_back(std::move(a));
+      std::push_heap(queue_.begin(), queue_.end(), &Tier::HeapLess);
+    }
+    queue_depth_.store(static_cast<int>(queue_.size()));
+  }
+  queue_cv_.notify_all();
+  if (enqueue_listener_) enqueue_listener_();
+  attempts.clear();
+}
+
+// Caller holds queue_mutex_ and has checked the queue is non-empty.
+QueuedAttempt Tier::PopTop() {
+  std::pop_heap(queue_.begin(), queue_.end(), &Tier::HeapLess);
+  QueuedAttempt out = std::move(queue_.back());
+  queue_.pop_back();
+  queue_depth_.store(static_cast<int>(queue_.size()));
+  return out;
+}
+
+void Tier::SetEnqueueListener(std::function<void()> listener) {
+  enqueue_listener_ = std::move(listener);
+}
+
+bool Tier::TryDequeueWithTokens(QueuedAttempt& out) {
+  std::lock_guard lock(queue_mutex_);
+  if (queue_.empty() || in_flight_.load() >= config_.concurrency_cap) {
+    return false;
+  }
+  if (!token_bucket_->TryAcquire(static_cast<double>(queue_.front().tokens_needed))) {
+    return false;
+  }
+  out = PopTop();
+  in_flight_.fetch_add(1);
+  return true;
 }
 
 bool Tier::TryDequeue(QueuedAttempt& out) {
@@ -64,8 +151,7 @@ bool Tier::TryDequeue(QueuedAttempt& out) {
   if (queue_.empty() || in_flight_.load() >= config_.concurrency_cap) {
     return false;
   }
-  out = std::move(queue_.front());
-  queue_.pop();
+  out = PopTop();
   in_flight_.fetch_add(1);
   return true;
 }
@@ -75,8 +161,7 @@ void Tier::BlockingDequeue(QueuedAttempt& out) {
   queue_cv_.wait(lock, [this] {
     return !queue_.empty() && in_flight_.load() < config_.concurrency_cap;
   });
-  out = std::move(queue_.front());
-  queue_.pop();
+  out = PopTop();
   in_flight_.fetch_add(1);
 }
 
@@ -90,8 +175,7 @@ bool Tier::TimedDequeue(QueuedAttempt& out, std::chrono::milliseconds timeout) {
     return !queue_.empty() && in_flight_.load() < config_.concurrency_cap;
   });
   if (!ok) return false;
-  out = std::move(queue_.front());
-  queue_.pop();
+  out = PopTop();
   in_flight_.fetch_add(1);
   return true;
 }
@@ -175,25 +259,16 @@ LatencySample LatencySampler::Sample(const LatencyContext& ctx, int timeout_ms,
 
 ProviderManager::ProviderManager(const ProviderConfig& config, double time_scale) {
   for (const auto& tc : config.tiers) {
-    tier_index_[tc.provider][tc.tier_id] = tiers_.size();
+    if (tc.tier_id < 0 || tc.tier_id >= kMaxTiersPerProvider) {
+      throw std::runtime_error("Tier id out of range for dense lookup: " +
+                               std::to_string(tc.tier_id));
+    }
+    const std::size_t slot = static_cast<std::size_t>(tc.provider_id) * kMaxTiersPerProvider +
+                             static_cast<std::size_t>(tc.tier_id);
+    if (slot >= tier_table_.size()) tier_table_.resize(slot + 1, nullptr);
     tiers_.push_back(std::make_unique<Tier>(tc, time_scale));
+    tier_table_[slot] = tiers_.back().get();
   }
 }
 
-Tier* ProviderManager::GetTier(const std::string& provider, int tier_id) {
-  auto pit = tier_index_.find(provider);
-  if (pit == tier_index_.end()) return nullptr;
-  auto tit = pit->second.find(tier_id);
-  if (tit == pit->second.end()) return nullptr;
-  return tiers_[tit->second].get();
-}
-
-const Tier* ProviderManager::GetTier(const std::string& provider, int tier_id) const {
-  auto pit = tier_index_.find(provider);
-  if (pit == tier_index_.end()) return nullptr;
-  auto tit = pit->second.find(tier_id);
-  if (tit == pit->second.end()) return nullptr;
-  return tiers_[tit->second].get();
-}
-
 }  // namespace sim
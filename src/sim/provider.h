@@ -1,5 +1,6 @@
 #pragma once
 
+#include "sim/cancellation.h"
 #include "sim/config.h"
 #include "sim/random.h"
 #include "sim/types.h"
@@ -7,13 +8,12 @@
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <mutex>
-#include <queue>
 #include <string>
 #include <thread>
-#include <unordered_map>
 #include <vector>
 
 namespace sim {
@@ -35,22 +35,37 @@ struct LatencySample {
 
 // Thread-safe token bucket: rate r tokens/sec, capacity B.
 // Acquire(tokens) blocks until tokens are available.
+//
+// Tokens are held in fixed-point micro-tokens in a single atomic, so the
+// common case -- a bucket with tokens to spare -- is one CAS decrement with
+// no lock and no wakeup traffic. Refill is lazy: the first caller to observe
+// elapsed time CAS-claims the interval and credits it; callers that lose the
+// race simply re-observe on their next attempt. Only an exhausted bucket
+// falls back to the slow path, which sleeps for the estimated deficit and
+// retries.
 class TokenBucket {
  public:
   TokenBucket(double rate_per_sec, double capacity, double time_scale = 1.0);
 
   void Acquire(double tokens);
+  // Non-blocking variant: takes tokens only if available (after a refill).
+  bool TryAcquire(double tokens);
 
  private:
+  static constexpr std::int64_t kMicroPerToken = 1'000'000;
+
+  std::int64_t NowNs() const;
   void Refill();
+  bool TryAcquireMicro(std::int64_t needed);
 
   double rate_per_sec_;
   double capacity_;
-  double tokens_;
   double time_scale_;
-  std::chrono::steady_clock::time_point last_refill_;
-  std::mutex mutex_;
-  std::condition_variable cv_;
+  std::int64_t capacity_micro_;
+  double micro_per_ns_;  // effective refill rate: micro-tokens per wall nanosecond
+  std::chrono::steady_clock::time_point epoch_;
+  std::atomic<std::int64_t> tokens_micro_;
+  std::atomic<std::int64_t> last_refill_ns_{0};
 };
 
 // Work item enqueued to a tier.
@@ -58,45 +73,77 @@ struct QueuedAttempt {
   NodeId node_id = 0;
   WorkflowId workflow_id = 0;
   NodeType node_type = NodeType::Plan;
-  std::string provider;
+  ProviderId provider_id = kLocalProviderId;
   int tier_id = 0;
   int tokens_needed = 1;
   int timeout_ms = 30'000;
   int max_retries = 3;
   LatencyContext latency_ctx;
   AttemptId attempt_id = 0;
-  std::atomic<bool>* cancelled = nullptr;  // worker checks; controller sets when cancelling
+  CancellationToken cancelled;  // executor checks; released/invalidated when the node resolves
+  double score = 0.0;       // scheduler's dispatch score; orders the tier queue
+  double enqueue_ms = 0.0;  // virtual enqueue time; ages queued attempts
 };
 
-// Single provider tier: queue, token bucket, concurrency cap.
+// Single provider tier: priority queue, token bucket, concurrency cap.
 class Tier {
  public:
   Tier(const TierConfig& config, double time_scale = 1.0);
 
   const TierConfig& config() const { return config_; }
-  const std::string& provider() const { return config_.provider; }
+  const std::string& provider() const { return config_.provider; }  // output boundary only
+  ProviderId provider_id() const { return config_.provider_id; }
   int tier_id() const { return config_.tier_id; }
   int concurrency_cap() const { return config_.concurrency_cap; }
   int in_flight() const { return in_flight_.load(); }
   bool can_accept() const { return in_flight_.load() < config_.concurrency_cap; }
+  // Dispatch-side backpressure: queue depth is mirrored in an atomic so the
+  // scheduler can test for room without touching the queue lock.
+  int queue_depth() const { return queue_depth_.load(); }
+  bool has_queue_room() const { return queue_depth_.load() < config_.max_queue_depth; }
 
   void Enqueue(QueuedAttempt attempt);
+  // Enqueues a dispatch tick's worth of attempts under one lock and fires the
+  // listener once; clears the input vector.
+  void EnqueueBatch(std::vector<QueuedAttempt>& attempts);
   bool TryDequeue(QueuedAttempt& out);
+  // Dequeues only if a concurrency slot and the front attempt's tokens are
+  // both available; never blocks. Used by the timer-driven executor.
+  bool TryDequeueWithTokens(QueuedAttempt& out);
   void BlockingDequeue(QueuedAttempt& out);
   bool TimedDequeue(QueuedAttempt& out, std::chrono::milliseconds timeout);
   void AcquireTokens(QueuedAttempt& attempt);
   void OnAttemptStart();
   void OnAttemptFinish();
 
+  // Invoked (without the queue lock) after each Enqueue so a sleeping
+  // executor can wake immediately. Set before any enqueues happen.
+  void SetEnqueueListener(std::function<void()> listener);
+
   TokenBucket& token_bucket() { return *token_bucket_; }
 
  private:
+  // The queue is a binary max-heap on effective priority
+  //   score + kAgingPerMs * (now - enqueue_ms),
+  // so the scheduler's DAG ordering survives congestion instead of decaying
+  // to FIFO. Since every entry ages at the same rate, the ordering equals a
+  // heap on the time-invariant key score - kAgingPerMs * enqueue_ms; the
+  // aging term still matters across enqueues, letting old low-score attempts
+  // overtake later high-score arrivals so nothing starves.
+  static constexpr double kAgingPerMs = 0.1;  // matches the scheduler's age weight (gamma)
+  static bool HeapLess(const QueuedAttempt& a, const QueuedAttempt& b) {
+    return a.score - kAgingPerMs * a.enqueue_ms < b.score - kAgingPerMs * b.enqueue_ms;
+  }
+  QueuedAttempt PopTop();
+
   TierConfig config_;
   std::unique_ptr<TokenBucket> token_bucket_;
-  std::queue<QueuedAttempt> queue_;
+  std::vector<QueuedAttempt> queue_;
   std::mutex queue_mutex_;
   std::condition_variable queue_cv_;
   std::atomic<int> in_flight_{0};
+  std::atomic<int> queue_depth_{0};
+  std::function<void()> enqueue_listener_;
 };
 
 // Samples latency and failure for attempts using config and seeded RNG.
@@ -116,15 +163,26 @@ class LatencySampler {
 // Manages all provider tiers.
 class ProviderManager {
  public:
+  // Upper bound on tier_id + 1 per provider; sizes the dense lookup table.
+  static constexpr int kMaxTiersPerProvider = 4;
+
   explicit ProviderManager(const ProviderConfig& config, double time_scale = 1.0);
 
-  Tier* GetTier(const std::string& provider, int tier_id);
-  const Tier* GetTier(const std::string& provider, int tier_id) const;
+  // Dense-array lookup: no hashing on the dispatch path. Returns nullptr for
+  // the local pseudo-provider or an unknown (provider, tier) pair.
+  Tier* GetTier(ProviderId provider_id, int tier_id) {
+    const std::size_t slot = static_cast<std::size_t>(provider_id) * kMaxTiersPerProvider +
+                             static_cast<std::size_t>(tier_id);
+    return slot < tier_table_.size() ? tier_table_[slot] : nullptr;
+  }
+  const Tier* GetTier(ProviderId provider_id, int tier_id) const {
+    return const_cast<ProviderManager*>(this)->GetTier(provider_id, tier_id);
+  }
   const std::vector<std::unique_ptr<Tier>>& tiers() const { return tiers_; }
 
  private:
   std::vector<std::unique_ptr<Tier>> tiers_;
-  std::unordered_map<std::string, std::unordered_map<int, std::size_t>> tier_index_;
+  std::vector<Tier*> tier_table_;  // [provider_id * kMaxTiersPerProvider + tier_id]
 };
 
 }  // namespace sim
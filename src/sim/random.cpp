@@ -87,6 +87,12 @@ double SeededRng::Gamma(double shape, double scale) {
   }
 }
 
+double SeededRng::Exponential(double mean) {
+  double u = Uniform01();
+  while (u <= 0.0) u = Uniform01();
+  return -mean * std::log(u);
+}
+
 double SeededRng::Normal(double mean, double stddev) {
   double u1 = Uniform01();
   double u2 = Uniform01();
@@ -2,6 +2,7 @@
 
 #include "sim/types.h"
 
+#include <array>
 #include <cstdint>
 #include <cmath>
 #include <limits>
@@ -22,6 +23,14 @@ class SeededRng {
   double Lognormal(double mu, double sigma);
   double Gamma(double shape, double scale);
   double Normal(double mean, double stddev);
+  double Exponential(double mean);
+
+  // Snapshot support: the full xoshiro state, so a resumed run continues the
+  // exact random sequence of the run that wrote the snapshot.
+  std::array<std::uint64_t, 4> State() const { return {s_[0], s_[1], s_[2], s_[3]}; }
+  void SetState(const std::array<std::uint64_t, 4>& s) {
+    for (int i = 0; i < 4; ++i) s_[i] = s[static_cast<std::size_t>(i)];
+  }
 
  private:
   std::uint64_t s_[4];
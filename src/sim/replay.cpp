@@ -0,0 +1,69 @@
+#include "sim/replay.h"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace sim {
+
+static std::uint64_t NodeKey(WorkflowId workflow_id, NodeId node_id) {
+  // Mirrors the controller's cancel-token keying; node ids stay well under
+  // 32 bits in practice.
+  return (static_cast<std::uint64_t>(workflow_id) << 32) ^ node_id;
+}
+
+ReplayLog::ReplayLog(const std::string& path) : out_(path) {
+  ReplayFileHeader header;
+  out_.Append(&header, sizeof(header));
+}
+
+void ReplayLog::Record(WorkflowId workflow_id, NodeId node_id, const LatencySample& sample) {
+  std::lock_guard lock(mutex_);
+  ReplayRecord rec;
+  rec.service_time_ms = sample.service_time_ms;
+  rec.node_id = node_id;
+  rec.workflow_id = workflow_id;
+  rec.ordinal = next_ordinal_[NodeKey(workflow_id, node_id)]++;
+  rec.failed = sample.failed ? 1 : 0;
+  rec.timeout = sample.timeout ? 1 : 0;
+  out_.Append(&rec, sizeof(rec));
+}
+
+void ReplayLog::Close() {
+  std::lock_guard lock(mutex_);
+  out_.Close();
+}
+
+ReplaySource::ReplaySource(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    throw std::runtime_error("ReplaySource: cannot open " + path);
+  }
+  ReplayFileHeader header;
+  in.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!in || std::memcmp(header.magic, "ASRP", 4) != 0 || header.version != 1 ||
+      header.record_size != sizeof(ReplayRecord)) {
+    throw std::runtime_error("ReplaySource: incompatible outcomes file " + path);
+  }
+
+  // Records land in file order, which is ordinal order per (workflow, node),
+  // so appending reconstructs each node's sequence directly.
+  ReplayRecord rec;
+  while (in.read(reinterpret_cast<char*>(&rec), sizeof(rec))) {
+    LatencySample sample;
+    sample.service_time_ms = rec.service_time_ms;
+    sample.failed = rec.failed != 0;
+    sample.timeout = rec.timeout != 0;
+    by_node_[NodeKey(rec.workflow_id, rec.node_id)].samples.push_back(sample);
+  }
+}
+
+bool ReplaySource::Next(WorkflowId workflow_id, NodeId node_id, LatencySample* out) {
+  std::lock_guard lock(mutex_);
+  auto it = by_node_.find(NodeKey(workflow_id, node_id));
+  if (it == by_node_.end() || it->second.next >= it->second.samples.size()) return false;
+  *out = it->second.samples[it->second.next++];
+  return true;
+}
+
+}  // namespace sim
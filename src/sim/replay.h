@@ -0,0 +1,79 @@
+#pragma once
+
+#include "sim/mapped_file.h"
+#include "sim/provider.h"
+#include "sim/types.h"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace sim {
+
+// Record/replay of sampled attempt outcomes. A recording run appends every
+// service-time/failure realization keyed by (workflow, node, attempt
+// ordinal) to a compact binary file; a replaying run returns those values
+// instead of drawing from the RNG, so two policies compare on bit-identical
+// workload realizations regardless of draw ordering or thread interleaving.
+
+// Fixed-size binary record; the ordinal counts samples per (workflow, node)
+// in the order they were taken, so retries and hedges replay in sequence.
+struct ReplayRecord {
+  double service_time_ms = 0.0;
+  NodeId node_id = 0;
+  WorkflowId workflow_id = 0;
+  std::uint32_t ordinal = 0;
+  std::uint8_t failed = 0;
+  std::uint8_t timeout = 0;
+};
+static_assert(sizeof(ReplayRecord) == 32, "ReplayRecord must stay fixed-size");
+
+// Header at the start of an outcomes file, so replay can reject files
+// written by an incompatible build.
+struct ReplayFileHeader {
+  char magic[4] = {'A', 'S', 'R', 'P'};
+  std::uint32_t version = 1;
+  std::uint32_t record_size = sizeof(ReplayRecord);
+};
+
+// Appends sampled outcomes to an mmap-backed file. Thread-safe: the
+// realtime executor and DES engine record from their own threads.
+class ReplayLog {
+ public:
+  explicit ReplayLog(const std::string& path);
+
+  void Record(WorkflowId workflow_id, NodeId node_id, const LatencySample& sample);
+  // Trims and flushes the file. Idempotent; the destructor closes too.
+  void Close();
+
+ private:
+  std::mutex mutex_;
+  MappedFile out_;
+  std::unordered_map<std::uint64_t, std::uint32_t> next_ordinal_;
+};
+
+// Replays outcomes recorded by ReplayLog. Each (workflow, node) hands back
+// its samples in recorded order; a lookup past the recorded attempts (or for
+// a node the recording run never sampled) misses, and the caller falls back
+// to fresh sampling.
+class ReplaySource {
+ public:
+  // Loads the whole file; throws std::runtime_error if it is missing or
+  // incompatible.
+  explicit ReplaySource(const std::string& path);
+
+  bool Next(WorkflowId workflow_id, NodeId node_id, LatencySample* out);
+
+ private:
+  struct Entry {
+    std::vector<LatencySample> samples;
+    std::size_t next = 0;
+  };
+
+  std::mutex mutex_;
+  std::unordered_map<std::uint64_t, Entry> by_node_;
+};
+
+}  // namespace sim
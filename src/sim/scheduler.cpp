@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <cmath>
 #include <limits>
+#include <stdexcept>
 #include <string>
 
 namespace sim {
@@ -10,50 +11,192 @@ namespace sim {
 static const double kDefaultEstimateMs = 100.0;
 
 Scheduler::Scheduler(const SchedulerConfig& config, ProviderManager* provider_mgr,
-                    LatencyEstimateStore* latency_store, LocalQueue* cpu_queue,
-                    LocalQueue* io_queue, TraceWriter* trace)
-    : config_(config),
+                    LatencyEstimateStore* latency_store, LocalQueue* local_queue,
+                    CancellationPool* cancel_pool, TraceWriter* trace, PerfCounters* perf)
+    : dispatch_impl_(PickDispatch(config.policy, config.enable_model_routing)),
+      config_(config),
       provider_mgr_(provider_mgr),
       latency_store_(latency_store),
-      cpu_queue_(cpu_queue),
-      io_queue_(io_queue),
-      trace_(trace) {}
+      local_queue_(local_queue),
+      cancel_pool_(cancel_pool),
+      trace_(trace),
+      perf_(perf) {
+  // Name matching happens once here; every dispatch afterwards compares ids.
+  if (provider_mgr_) {
+    for (const auto& t : provider_mgr_->tiers()) {
+      if (t->provider() == "embed_provider") embed_provider_id_ = t->provider_id();
+      if (t->provider() == "llm_provider") llm_provider_id_ = t->provider_id();
+    }
+  }
 
-double Scheduler::RemainingCriticalPath(const Workflow& wf, NodeId nid) const {
-  const Node& n = wf.node(nid);
-  double est = kDefaultEstimateMs;
-  if (!n.preference_list.empty()) {
-    const auto& opt = n.preference_list.front();
-    est = latency_store_->GetP50(n.type, opt.provider, opt.tier_id);
+  // One worker per spare core, capped below typical shard counts: with 8
+  // shards there is nothing for a ninth thread to score.
+  const unsigned hw = std::thread::hardware_concurrency();
+  const std::size_t workers = std::min<std::size_t>(hw > 1 ? hw - 1 : 0, 7);
+  score_workers_.reserve(workers);
+  for (std::size_t i = 0; i < workers; ++i) {
+    score_workers_.emplace_back(&Scheduler::ScoreWorkerLoop, this);
   }
-  if (n.children.empty()) return est;
-  double max_child = 0.0;
-  for (NodeId cid : n.children) {
-    const Node& c = wf.node(cid);
-    if (IsTerminal(c.state)) continue;
-    double child_cp = RemainingCriticalPath(wf, cid);
-    if (child_cp > max_child) max_child = child_cp;
+}
+
+Scheduler::~Scheduler() {
+  {
+    std::lock_guard lock(pool_mutex_);
+    pool_shutdown_ = true;
   }
-  return est + max_child;
+  pool_cv_.notify_all();
+  for (std::thread& t : score_workers_) t.join();
 }
 
-std::vector<Scheduler::ScoredNode> Scheduler::ScoreAndSort(
-    std::unordered_map<WorkflowId, Workflow*>& workflows, double now_ms,
-    std::unordered_map<WorkflowId, double>& workflow_start_ms,
-    std::function<bool(NodeId, WorkflowId)> is_critical_path) {
-  (void)is_critical_path;
-  std::vector<ScoredNode> scored;
-  for (auto& [wf_id, wf] : workflows) {
+// Claims the next shard index of generation gen, or returns false if the
+// pass has run out of shards or a different generation is current. The CAS
+// covers generation and index together, so a successful claim is always for
+// the pass the claimant saw -- and RunScorePass cannot return before that
+// claim's task call finishes, because the claim holds pool_pending_ above
+// zero until it does.
+bool Scheduler::ClaimShard(std::uint64_t gen, std::size_t* index) {
+  std::uint64_t cur = pool_claim_.load();
+  while (true) {
+    if ((cur >> 32) != (gen & 0xffffffffULL)) return false;
+    const std::size_t i = static_cast<std::size_t>(cur & 0xffffffffULL);
+    if (i >= pool_limit_.load()) return false;
+    if (pool_claim_.compare_exchange_weak(cur, cur + 1)) {
+      *index = i;
+      return true;
+    }
+  }
+}
+
+void Scheduler::ScoreWorkerLoop() {
+  std::uint64_t seen = 0;
+  while (true) {
+    const std::function<void(std::size_t)>* task = nullptr;
+    {
+      std::unique_lock lock(pool_mutex_);
+      pool_cv_.wait(lock, [&] { return pool_shutdown_ || pool_generation_ != seen; });
+      if (pool_shutdown_) return;
+      seen = pool_generation_;
+      task = pool_task_;
+    }
+    std::size_t i;
+    while (ClaimShard(seen, &i)) {
+      (*task)(i);
+      std::lock_guard lock(pool_mutex_);
+      if (--pool_pending_ == 0) pool_done_cv_.notify_one();
+    }
+  }
+}
+
+void Scheduler::RunScorePass(std::size_t shard_count,
+                             const std::function<void(std::size_t)>& task) {
+  std::uint64_t gen;
+  {
+    std::lock_guard lock(pool_mutex_);
+    pool_task_ = &task;
+    pool_pending_ = shard_count;
+    pool_limit_.store(shard_count);
+    gen = ++pool_generation_;
+    pool_claim_.store((gen & 0xffffffffULL) << 32);
+  }
+  pool_cv_.notify_all();
+  // The dispatching thread claims shards too instead of idling.
+  std::size_t i;
+  while (ClaimShard(gen, &i)) {
+    task(i);
+    std::lock_guard lock(pool_mutex_);
+    if (--pool_pending_ == 0) pool_done_cv_.notify_one();
+  }
+  std::unique_lock lock(pool_mutex_);
+  pool_done_cv_.wait(lock, [&] { return pool_pending_ == 0; });
+}
+
+Scheduler::DispatchFn Scheduler::PickDispatch(SchedulerPolicy policy, bool model_routing) {
+  switch (policy) {
+    case SchedulerPolicy::fifo_cheapest:
+      return model_routing ? &Scheduler::DispatchImpl<SchedulerPolicy::fifo_cheapest, true>
+                           : &Scheduler::DispatchImpl<SchedulerPolicy::fifo_cheapest, false>;
+    case SchedulerPolicy::dag_cheapest:
+      return model_routing ? &Scheduler::DispatchImpl<SchedulerPolicy::dag_cheapest, true>
+                           : &Scheduler::DispatchImpl<SchedulerPolicy::dag_cheapest, false>;
+    case SchedulerPolicy::dag_escalation:
+      return model_routing ? &Scheduler::DispatchImpl<SchedulerPolicy::dag_escalation, true>
+                           : &Scheduler::DispatchImpl<SchedulerPolicy::dag_escalation, false>;
+    case SchedulerPolicy::full:
+      return model_routing ? &Scheduler::DispatchImpl<SchedulerPolicy::full, true>
+                           : &Scheduler::DispatchImpl<SchedulerPolicy::full, false>;
+  }
+  throw std::runtime_error("Unknown scheduler policy");
+}
+
+double Scheduler::NodeEstimateMs(const Node& n) const {
+  if (n.preference_list.empty()) return kDefaultEstimateMs;
+  const auto& opt = n.preference_list.front();
+  return latency_store_->GetP50(n.type, opt.provider_id, opt.tier_id);
+}
+
+const std::unordered_map<NodeId, double>& Scheduler::RemCpTable(const Workflow& wf) const {
+  CpCacheEntry& entry = cp_cache_[wf.id() % cp_cache_.size()][wf.id()];
+  if (entry.epoch == wf.change_epoch()) return entry.rem_cp;
+  PerfScope perf_scope(perf_, PerfPhase::rem_cp_rebuild);
+
+  entry.rem_cp.clear();
+  entry.rem_cp.reserve(wf.nodes().size());
+
+  // Bottom-up: rem_cp(n) = est(n) + max over non-terminal children. Terminal
+  // nodes contribute nothing. Iterative post-order keeps this O(nodes + edges)
+  // per recompute regardless of shared ancestry in the DAG.
+  std::vector<std::pair<NodeId, bool>> stack;
+  for (const Node& n : wf.nodes()) {
+    if (entry.rem_cp.count(n.id)) continue;
+    stack.emplace_back(n.id, false);
+    while (!stack.empty()) {
+      auto [cur, expanded] = stack.back();
+      stack.pop_back();
+      const Node& node = wf.node(cur);
+      if (expanded) {
+        double max_child = 0.0;
+        for (NodeId cid : node.children) {
+          auto it = entry.rem_cp.find(cid);
+          if (it != entry.rem_cp.end() && it->second > max_child) max_child = it->second;
+        }
+        entry.rem_cp[cur] = IsTerminal(node.state) ? 0.0 : NodeEstimateMs(node) + max_child;
+        continue;
+      }
+      if (entry.rem_cp.count(cur)) continue;
+      stack.emplace_back(cur, true);
+      for (NodeId cid : node.children) {
+        if (!entry.rem_cp.count(cid)) stack.emplace_back(cid, false);
+      }
+    }
+  }
+
+  entry.epoch = wf.change_epoch();
+  return entry.rem_cp;
+}
+
+double Scheduler::RemainingCriticalPath(const Workflow& wf, NodeId nid) const {
+  const auto& table = RemCpTable(wf);
+  auto it = table.find(nid);
+  return it != table.end() ? it->second : kDefaultEstimateMs;
+}
+
+template <SchedulerPolicy P>
+int Scheduler::ScoreShard(ShardView& shard, int shard_idx, double now_ms,
+                          std::vector<ScoredNode>& out) {
+  int in_flight = 0;
+  for (auto& [wf_id, wf] : *shard.workflows) {
     if (!wf || wf->done()) continue;
+    in_flight += wf->in_flight_count();
     const auto runnable = wf->RunnableNodes();
-    const double start_ms = workflow_start_ms[wf_id];
+    const double start_ms = (*shard.workflow_start_ms)[wf_id];
     for (NodeId nid : runnable) {
       const Node& n = wf->node(nid);
       double score = 0.0;
       double age_ms = now_ms - start_ms;
 
-      if (config_.disable_dag_priority ||
-          config_.policy == SchedulerPolicy::fifo_cheapest) {
+      if constexpr (P == SchedulerPolicy::fifo_cheapest) {
+        score = age_ms;
+      } else if (config_.disable_dag_priority) {
         score = age_ms;
       } else {
         const double rem_cp = RemainingCriticalPath(*wf, nid);
@@ -70,7 +213,7 @@ std::vector<Scheduler::ScoredNode> Scheduler::ScoreAndSort(
             double my_est = kDefaultEstimateMs;
             if (!n.preference_list.empty()) {
               const auto& opt = n.preference_list.front();
-              my_est = latency_store_->GetP50(n.type, opt.provider, opt.tier_id);
+              my_est = latency_store_->GetP50(n.type, opt.provider_id, opt.tier_id);
             }
             slack = std::max(0.0, min_child_start - my_est);
           }
@@ -78,14 +221,13 @@ std::vector<Scheduler::ScoredNode> Scheduler::ScoreAndSort(
         score = config_.alpha * rem_cp + config_.beta * (1.0 / (1.0 + slack)) +
                 config_.gamma * age_ms;
       }
-      scored.push_back({nid, wf_id, score, age_ms});
+      out.push_back({nid, wf_id, score, age_ms, shard_idx});
     }
   }
-  std::sort(scored.begin(), scored.end(),
-            [](const ScoredNode& a, const ScoredNode& b) { return a.score > b.score; });
-  return scored;
+  return in_flight;
 }
 
+template <SchedulerPolicy P>
 const ExecutionOption* Scheduler::SelectOption(
     const Node& n, std::unordered_map<WorkflowId, double>& workflow_cost, bool is_critical) {
   if (n.preference_list.empty()) return nullptr;
@@ -93,55 +235,153 @@ const ExecutionOption* Scheduler::SelectOption(
   const ExecutionOption* chosen = nullptr;
   for (const auto& opt : n.preference_list) {
     if (opt.price_per_call > budget_left) continue;
-    Tier* t = provider_mgr_->GetTier(opt.provider, opt.tier_id);
-    if (!t || !t->can_accept()) continue;
+    Tier* t = provider_mgr_->GetTier(opt.provider_id, opt.tier_id);
+    if (!t || !t->can_accept() || !t->has_queue_room()) continue;
     chosen = &opt;
-    if (config_.disable_escalation || config_.policy == SchedulerPolicy::fifo_cheapest ||
-        config_.policy == SchedulerPolicy::dag_cheapest) {
+    if constexpr (P == SchedulerPolicy::fifo_cheapest || P == SchedulerPolicy::dag_cheapest) {
+      break;
+    } else {
+      if (config_.disable_escalation) break;
+      if (!is_critical) break;
+      const double delta_cost = opt.price_per_call - n.preference_list.front().price_per_call;
+      if (delta_cost <= 0) break;
+      const double ect_cheap =
+          latency_store_->GetP95QueueWait(n.preference_list.front().provider_id,
+                                         n.preference_list.front().tier_id) +
+          latency_store_->GetP50(n.type, n.preference_list.front().provider_id,
+                                n.preference_list.front().tier_id);
+      const double ect_fast =
+          latency_store_->GetP95QueueWait(opt.provider_id, opt.tier_id) +
+          latency_store_->GetP50(n.type, opt.provider_id, opt.tier_id);
+      const double benefit = ect_cheap - ect_fast;
+      if (benefit / delta_cost >= config_.escalation_benefit_cost_threshold) {
+        chosen = &opt;
+      }
       break;
     }
-    if (!is_critical) break;
-    const double delta_cost = opt.price_per_call - n.preference_list.front().price_per_call;
-    if (delta_cost <= 0) break;
-    const double ect_cheap =
-        latency_store_->GetP95QueueWait(n.preference_list.front().provider,
-                                       n.preference_list.front().tier_id) +
-        latency_store_->GetP50(n.type, n.preference_list.front().provider,
-                              n.preference_list.front().tier_id);
-    const double ect_fast =
-        latency_store_->GetP95QueueWait(opt.provider, opt.tier_id) +
-        latency_store_->GetP50(n.type, opt.provider, opt.tier_id);
-    const double benefit = ect_cheap - ect_fast;
-    if (benefit / delta_cost >= config_.escalation_benefit_cost_threshold) {
-      chosen = &opt;
-    }
-    break;
   }
   return chosen ? chosen : (n.preference_list.empty() ? nullptr : &n.preference_list.front());
 }
 
-int Scheduler::Dispatch(std::unordered_map<WorkflowId, Workflow*>& workflows, double now_ms,
-                         std::unordered_map<WorkflowId, double>& workflow_cost,
-                         std::unordered_map<WorkflowId, double>& workflow_start_ms,
+int Scheduler::Dispatch(std::vector<ShardView>& shards, double now_ms,
                          std::atomic<AttemptId>& next_attempt_id,
-                         std::unordered_map<std::uint64_t, std::atomic<bool>*>& cancelled_flags,
                          std::function<bool(NodeId, WorkflowId)> is_critical_path,
                          std::function<void(WorkflowId, NodeId, double)> on_dispatch) {
-  auto scored = ScoreAndSort(workflows, now_ms, workflow_start_ms, is_critical_path);
+  return (this->*dispatch_impl_)(shards, now_ms, next_attempt_id, is_critical_path,
+                                 on_dispatch);
+}
 
+template <SchedulerPolicy P, bool ModelRouting>
+int Scheduler::DispatchImpl(std::vector<ShardView>& shards, double now_ms,
+                            std::atomic<AttemptId>& next_attempt_id,
+                            const std::function<bool(NodeId, WorkflowId)>& is_critical_path,
+                            const std::function<void(WorkflowId, NodeId, double)>& on_dispatch) {
+  PerfScope perf_total(perf_, PerfPhase::dispatch_total);
+
+  // Phase 1: snapshot scored candidates shard by shard, holding each shard's
+  // lock only while scoring it. Shards score in parallel on the worker pool;
+  // the cp cache stripes by the same workflow-id modulus the controller
+  // shards by, so a worker scoring shard si touches only stripe si.
+  const std::size_t shard_count = shards.size();
+  if (cp_cache_.size() != shard_count) {
+    cp_cache_.assign(shard_count, {});
+  }
+  if (score_buffers_.size() < shard_count) score_buffers_.resize(shard_count);
+  if (shard_in_flight_.size() < shard_count) shard_in_flight_.resize(shard_count);
+
+  std::vector<ScoredNode> scored;
   int in_flight = 0;
-  for (auto& [wf_id, wf] : workflows) {
-    if (!wf || wf->done()) continue;
-    for (const auto& [nid, n] : wf->nodes()) {
-      if (n.state == NodeState::Queued || n.state == NodeState::Running) ++in_flight;
+  {
+    PerfScope perf_score(perf_, PerfPhase::score_pass);
+    if (!score_workers_.empty() && shard_count > 1) {
+      const std::function<void(std::size_t)> score_one = [&](std::size_t si) {
+        score_buffers_[si].clear();
+        std::unique_lock lock(*shards[si].mutex, std::defer_lock);
+        {
+          PerfScope perf_lock(perf_, PerfPhase::shard_lock_wait);
+          lock.lock();
+        }
+        shard_in_flight_[si] =
+            ScoreShard<P>(shards[si], static_cast<int>(si), now_ms, score_buffers_[si]);
+      };
+      RunScorePass(shard_count, score_one);
+
+      std::size_t total = 0;
+      for (std::size_t si = 0; si < shard_count; ++si) total += score_buffers_[si].size();
+      scored.reserve(total);
+      // Concatenate in shard order: the sequence fed to the sort below matches
+      // the sequential pass, so ties resolve identically.
+      for (std::size_t si = 0; si < shard_count; ++si) {
+        scored.insert(scored.end(), score_buffers_[si].begin(), score_buffers_[si].end());
+        in_flight += shard_in_flight_[si];
+      }
+    } else {
+      for (std::size_t si = 0; si < shard_count; ++si) {
+        std::unique_lock lock(*shards[si].mutex, std::defer_lock);
+        {
+          PerfScope perf_lock(perf_, PerfPhase::shard_lock_wait);
+          lock.lock();
+        }
+        in_flight += ScoreShard<P>(shards[si], static_cast<int>(si), now_ms, scored);
+      }
     }
   }
+  // Selection is lazy: dispatch consumes at most the remaining global
+  // in-flight budget, so only that many candidates get sorted up front
+  // (O(n + K log n) via partial_sort instead of a full O(n log n) sort).
+  // Skipped candidates -- stale snapshot entries, saturated tiers, budget
+  // filters -- extend the sorted prefix another chunk, so the dispatch
+  // sequence is identical to a full sort under the same total order. Ties
+  // break on (workflow, node) id so the order is canonical rather than an
+  // artifact of sort internals.
+  const auto better = [](const ScoredNode& a, const ScoredNode& b) {
+    if (a.score != b.score) return a.score > b.score;
+    if (a.workflow_id != b.workflow_id) return a.workflow_id < b.workflow_id;
+    return a.node_id < b.node_id;
+  };
+  const std::size_t budget =
+      in_flight < config_.max_in_flight_global
+          ? static_cast<std::size_t>(config_.max_in_flight_global - in_flight)
+          : 0;
+  std::size_t sorted_limit = 0;
+  const auto extend_sorted = [&](std::size_t want) {
+    want = std::min(want, scored.size());
+    if (want <= sorted_limit) return;
+    PerfScope perf_sort(perf_, PerfPhase::selection_sort);
+    // Everything before sorted_limit already outranks the tail, so sorting
+    // the next chunk of the tail preserves the global order.
+    std::partial_sort(scored.begin() + static_cast<std::ptrdiff_t>(sorted_limit),
+                      scored.begin() + static_cast<std::ptrdiff_t>(want), scored.end(), better);
+    sorted_limit = want;
+  };
+  extend_sorted(budget);
 
+  // Phase 2: dispatch in global score order, re-locking only the owning
+  // shard per candidate. Candidates may have completed or been cancelled
+  // since the snapshot; the Runnable check below filters those out.
+  // Tier-bound attempts are grouped per destination and enqueued in one
+  // batch after the loop, so tier lock traffic scales with ticks rather
+  // than with attempts. Few tiers exist, so a flat list beats a map.
+  std::vector<std::pair<Tier*, std::vector<QueuedAttempt>>> tier_batches;
   int dispatched = 0;
-  for (const auto& sn : scored) {
+  // Extension chunks double each time: under heavy skipping (saturated
+  // tiers) a fixed budget-sized chunk re-scans the unsorted tail dozens of
+  // times per tick, so growth keeps the extension count logarithmic.
+  std::size_t extend_chunk = std::max<std::size_t>(budget, 1);
+  PerfScope perf_loop(perf_, PerfPhase::dispatch_loop);
+  for (std::size_t idx = 0; idx < scored.size(); ++idx) {
     if (in_flight >= config_.max_in_flight_global) break;
+    if (idx == sorted_limit) {
+      extend_sorted(sorted_limit + extend_chunk);
+      extend_chunk *= 2;
+    }
+    const ScoredNode& sn = scored[idx];
 
-    Workflow* wf = workflows[sn.workflow_id];
+    ShardView& shard = shards[static_cast<std::size_t>(sn.shard)];
+    std::lock_guard lock(*shard.mutex);
+    auto wf_it = shard.workflows->find(sn.workflow_id);
+    if (wf_it == shard.workflows->end()) continue;
+    Workflow* wf = wf_it->second;
     if (!wf || wf->done()) continue;
 
     Node& n = wf->node_mut(sn.node_id);
@@ -160,10 +400,7 @@ int Scheduler::Dispatch(std::unordered_map<WorkflowId, Workflow*>& workflows, do
       task.attempt_id = next_attempt_id.fetch_add(1);
 
       wf->MarkQueued(sn.node_id);
-      if (n.resource_class == ResourceClass::cpu)
-        cpu_queue_->Push(std::move(task));
-      else
-        io_queue_->Push(std::move(task));
+      local_queue_->Push(std::move(task));
       if (trace_) trace_->Emit(TraceEvent::NodeQueued, now_ms, sn.workflow_id, sn.node_id, "local");
       if (on_dispatch) on_dispatch(sn.workflow_id, sn.node_id, now_ms);
       ++dispatched;
@@ -171,48 +408,67 @@ int Scheduler::Dispatch(std::unordered_map<WorkflowId, Workflow*>& workflows, do
       continue;
     }
 
-    std::string dispatch_provider;
+    ProviderId dispatch_provider_id = kLocalProviderId;
     int dispatch_tier_id = 0;
     int dispatch_timeout_ms = 30'000;
     int dispatch_max_retries = 3;
     Tier* tier = nullptr;
 
-    if (config_.enable_model_routing && !n.preference_list.empty()) {
-      const bool is_critical = is_critical_path ? is_critical_path(sn.node_id, sn.workflow_id) : false;
-      const ExecutionOption* opt = SelectOption(n, workflow_cost, is_critical);
-      if (!opt) continue;
-      tier = provider_mgr_->GetTier(opt->provider, opt->tier_id);
-      if (!tier || !tier->can_accept()) continue;
-      dispatch_provider = opt->provider;
-      dispatch_tier_id = opt->tier_id;
-      dispatch_timeout_ms = opt->timeout_ms;
-      dispatch_max_retries = opt->max_retries;
-    } else {
-      const char* provider_name =
-          (n.resource_class == ResourceClass::embed) ? "embed_provider" : "llm_provider";
+    if constexpr (ModelRouting) {
+      if (!n.preference_list.empty()) {
+        const bool is_critical =
+            is_critical_path ? is_critical_path(sn.node_id, sn.workflow_id) : false;
+        const ExecutionOption* opt = SelectOption<P>(n, *shard.workflow_cost, is_critical);
+        if (!opt) continue;
+        tier = provider_mgr_->GetTier(opt->provider_id, opt->tier_id);
+        if (!tier || !tier->can_accept() || !tier->has_queue_room()) continue;
+        dispatch_provider_id = opt->provider_id;
+        dispatch_tier_id = opt->tier_id;
+        dispatch_timeout_ms = opt->timeout_ms;
+        dispatch_max_retries = opt->max_retries;
+      }
+    }
+    if (!tier) {
+      const ProviderId want =
+          (n.resource_class == ResourceClass::embed) ? embed_provider_id_ : llm_provider_id_;
       for (const auto& t : provider_mgr_->tiers()) {
-        if (t->provider() == provider_name && t->can_accept()) {
+        if (t->provider_id() == want && t->can_accept() && t->has_queue_room()) {
           tier = t.get();
           break;
         }
       }
       if (!tier) continue;
-      dispatch_provider = tier->provider();
+      dispatch_provider_id = tier->provider_id();
       dispatch_tier_id = tier->tier_id();
       dispatch_timeout_ms = tier->config().default_timeout_ms;
       dispatch_max_retries = tier->config().default_max_retries;
     }
 
+    // Count this tick's still-unflushed batch against the cap, so one tick
+    // cannot overshoot the depth limit no matter how many candidates pick
+    // the same tier.
+    auto batch_it = std::find_if(tier_batches.begin(), tier_batches.end(),
+                                 [tier](const auto& tb) { return tb.first == tier; });
+    const auto pending =
+        batch_it == tier_batches.end() ? 0 : static_cast<int>(batch_it->second.size());
+    if (tier->queue_depth() + pending >= tier->config().max_queue_depth) continue;
+
     const std::uint64_t key =
         (static_cast<std::uint64_t>(sn.workflow_id) << 32) | static_cast<std::uint64_t>(sn.node_id);
-    auto* flag = new std::atomic<bool>(false);
-    cancelled_flags[key] = flag;
+    CancellationToken token = cancel_pool_->Acquire();
+    auto [tok_it, inserted] = shard.cancel_tokens->emplace(key, token);
+    if (!inserted) {
+      // Re-dispatch after a retry: invalidate the previous attempt's token so
+      // its slot recycles instead of lingering in the map.
+      cancel_pool_->Release(tok_it->second);
+      tok_it->second = token;
+    }
 
     QueuedAttempt attempt;
     attempt.node_id = sn.node_id;
     attempt.workflow_id = sn.workflow_id;
     attempt.node_type = n.type;
-    attempt.provider = dispatch_provider;
+    attempt.provider_id = dispatch_provider_id;
     attempt.tier_id = dispatch_tier_id;
     attempt.tokens_needed = 1;
     attempt.timeout_ms = dispatch_timeout_ms;
@@ -220,16 +476,24 @@ int Scheduler::Dispatch(std::unordered_map<WorkflowId, Workflow*>& workflows, do
     attempt.latency_ctx.node_type = n.type;
     attempt.latency_ctx.token_length_est = static_cast<std::size_t>(n.output_size_est);
     attempt.attempt_id = next_attempt_id.fetch_add(1);
-    attempt.cancelled = flag;
+    attempt.cancelled = token;
+    attempt.score = sn.score;
+    attempt.enqueue_ms = now_ms;
 
     wf->MarkQueued(sn.node_id);
-    tier->Enqueue(std::move(attempt));
+    if (batch_it == tier_batches.end()) {
+      tier_batches.emplace_back(tier, std::vector<QueuedAttempt>{});
+      batch_it = std::prev(tier_batches.end());
+    }
+    batch_it->second.push_back(std::move(attempt));
     if (trace_) trace_->Emit(TraceEvent::NodeQueued, now_ms, sn.workflow_id, sn.node_id,
-                            dispatch_provider + "_" + std::to_string(dispatch_tier_id));
+                            tier->provider() + "_" + std::to_string(dispatch_tier_id));
     if (on_dispatch) on_dispatch(sn.workflow_id, sn.node_id, now_ms);
     ++dispatched;
     ++in_flight;
   }
+
+  for (auto& [tier, batch] : tier_batches) tier->EnqueueBatch(batch);
   return dispatched;
 }
 
@@ -2,14 +2,19 @@
 
 #include "sim/config.h"
 #include "sim/metrics.h"
+#include "sim/perf.h"
 #include "sim/provider.h"
 #include "sim/trace.h"
 #include "sim/types.h"
 #include "sim/workflow.h"
 #include "sim/worker.h"
 
+#include <atomic>
+#include <condition_variable>
 #include <cstdint>
 #include <functional>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -36,52 +41,143 @@ struct SchedulerConfig {
   bool enable_model_routing = false;
 };
 
+// One lockable partition of controller workflow state. The scheduler scores
+// candidates per shard under that shard's lock, merges into a single global
+// priority order, then re-locks only the owning shard for each dispatch, so
+// result processing on other shards proceeds concurrently.
+// cancel_tokens: key = (wf_id << 32) | node_id for unique identification.
+struct ShardView {
+  std::mutex* mutex = nullptr;
+  std::unordered_map<WorkflowId, Workflow*>* workflows = nullptr;  // live (not done) only
+  std::unordered_map<WorkflowId, double>* workflow_cost = nullptr;
+  std::unordered_map<WorkflowId, double>* workflow_start_ms = nullptr;
+  std::unordered_map<std::uint64_t, CancellationToken>* cancel_tokens = nullptr;
+};
+
 // Dispatches runnable nodes to provider/local queues.
 // Caller provides workflows, provider manager, local queues, and shared state.
 class Scheduler {
  public:
   Scheduler(const SchedulerConfig& config, ProviderManager* provider_mgr,
-            LatencyEstimateStore* latency_store, LocalQueue* cpu_queue, LocalQueue* io_queue,
-            TraceWriter* trace);
+            LatencyEstimateStore* latency_store, LocalQueue* local_queue,
+            CancellationPool* cancel_pool, TraceWriter* trace, PerfCounters* perf = nullptr);
+  ~Scheduler();
 
-  // Dispatch pass: score runnable nodes, select options, enqueue.
-  // workflows: mutable refs; caller holds lock.
-  // cancelled_flags: key = (wf_id << 32) | node_id for unique identification.
-  // on_dispatch: optional callback (wf_id, node_id, now_ms) when a task is enqueued.
+  // Dispatch pass: score runnable nodes across all shards, select options,
+  // enqueue in global score order.
+  // on_dispatch: optional callback (wf_id, node_id, now_ms) when a task is
+  // enqueued; invoked with the owning shard's lock held.
   // Returns number of nodes dispatched.
-  int Dispatch(std::unordered_map<WorkflowId, Workflow*>& workflows, double now_ms,
-               std::unordered_map<WorkflowId, double>& workflow_cost,
-               std::unordered_map<WorkflowId, double>& workflow_start_ms,
+  // Forwards to the DispatchImpl instantiation chosen at construction.
+  int Dispatch(std::vector<ShardView>& shards, double now_ms,
                std::atomic<AttemptId>& next_attempt_id,
-               std::unordered_map<std::uint64_t, std::atomic<bool>*>& cancelled_flags,
                std::function<bool(NodeId, WorkflowId)> is_critical_path,
                std::function<void(WorkflowId, NodeId, double)> on_dispatch = nullptr);
 
+  // Drops cached per-workflow state once a workflow completes, so the memo
+  // stays bounded under streaming arrivals.
+  void ForgetWorkflow(WorkflowId id) {
+    if (!cp_cache_.empty()) cp_cache_[id % cp_cache_.size()].erase(id);
+  }
+
  private:
   struct ScoredNode {
     NodeId node_id;
     WorkflowId workflow_id;
     double score;
     double age_ms;
+    int shard;
   };
 
-  std::vector<ScoredNode> ScoreAndSort(
-      std::unordered_map<WorkflowId, Workflow*>& workflows, double now_ms,
-      std::unordered_map<WorkflowId, double>& workflow_start_ms,
-      std::function<bool(NodeId, WorkflowId)> is_critical_path);
+  // Policy and model routing are fixed for a run, so the scoring and option
+  // selection loops are instantiated per <policy, routing> pair: fifo compiles
+  // to a tight age-only loop with no critical-path or latency-store work, and
+  // the full policy loses the per-node policy branches. The constructor picks
+  // the instantiation once.
+  template <SchedulerPolicy P, bool ModelRouting>
+  int DispatchImpl(std::vector<ShardView>& shards, double now_ms,
+                   std::atomic<AttemptId>& next_attempt_id,
+                   const std::function<bool(NodeId, WorkflowId)>& is_critical_path,
+                   const std::function<void(WorkflowId, NodeId, double)>& on_dispatch);
 
+  // Appends scored candidates for one shard; caller holds the shard lock.
+  // Returns the shard's in-flight attempt count.
+  template <SchedulerPolicy P>
+  int ScoreShard(ShardView& shard, int shard_idx, double now_ms,
+                 std::vector<ScoredNode>& out);
+
+  template <SchedulerPolicy P>
   const ExecutionOption* SelectOption(const Node& n,
                                       std::unordered_map<WorkflowId, double>& workflow_cost,
                                       bool is_critical);
 
+  using DispatchFn = int (Scheduler::*)(
+      std::vector<ShardView>&, double, std::atomic<AttemptId>&,
+      const std::function<bool(NodeId, WorkflowId)>&,
+      const std::function<void(WorkflowId, NodeId, double)>&);
+  static DispatchFn PickDispatch(SchedulerPolicy policy, bool model_routing);
+
   double RemainingCriticalPath(const Workflow& wf, NodeId nid) const;
 
+  // Per-workflow memo of remaining-critical-path values. Recomputed in one
+  // bottom-up pass when the workflow's change_epoch moves (node added or
+  // reached a terminal state); otherwise reused across Dispatch ticks.
+  // Striped by workflow id with one map per shard (the same modulus the
+  // controller shards by), so each scoring worker mutates only the stripes
+  // belonging to the shards it scores -- no lock needed.
+  struct CpCacheEntry {
+    std::uint64_t epoch = ~0ULL;
+    std::unordered_map<NodeId, double> rem_cp;
+  };
+  const std::unordered_map<NodeId, double>& RemCpTable(const Workflow& wf) const;
+  double NodeEstimateMs(const Node& n) const;
+
+  mutable std::vector<std::unordered_map<WorkflowId, CpCacheEntry>> cp_cache_;
+
+  // ---- Parallel scoring pool ----
+  //
+  // Phase 1 of a dispatch tick scores each shard under that shard's lock;
+  // the shards are independent, so they fan out across a small pool (the
+  // dispatching thread participates instead of idling). Per-shard results
+  // land in per-shard buffers and are concatenated in shard order before the
+  // global sort, so the merged candidate sequence -- and therefore every
+  // dispatch decision -- is identical to the sequential pass.
+  void ScoreWorkerLoop();
+  bool ClaimShard(std::uint64_t gen, std::size_t* index);
+  void RunScorePass(std::size_t shard_count, const std::function<void(std::size_t)>& task);
+
+  std::vector<std::thread> score_workers_;
+  std::mutex pool_mutex_;
+  std::condition_variable pool_cv_;
+  std::condition_variable pool_done_cv_;
+  const std::function<void(std::size_t)>* pool_task_ = nullptr;
+  // Claim word: generation in the high 32 bits, next shard index in the low
+  // 32. Claims are CASes that only succeed while the generation matches the
+  // pass the claimant saw, so a worker that straggles past the end of a pass
+  // can neither claim into the next pass nor bump its index counter -- the
+  // stale task pointer it still holds is never invoked again.
+  std::atomic<std::uint64_t> pool_claim_{0};
+  std::atomic<std::size_t> pool_limit_{0};
+  std::size_t pool_pending_ = 0;  // shards not yet scored this pass
+  std::uint64_t pool_generation_ = 0;
+  bool pool_shutdown_ = false;
+
+  // Reused across ticks so a pass allocates only when shards grow.
+  std::vector<std::vector<ScoredNode>> score_buffers_;
+  std::vector<int> shard_in_flight_;
+
+  DispatchFn dispatch_impl_;
   SchedulerConfig config_;
+  // Resolved once at construction so the fallback tier-selection path matches
+  // tiers by interned id instead of comparing provider name strings.
+  ProviderId embed_provider_id_ = kLocalProviderId;
+  ProviderId llm_provider_id_ = kLocalProviderId;
   ProviderManager* provider_mgr_;
   LatencyEstimateStore* latency_store_;
-  LocalQueue* cpu_queue_;
-  LocalQueue* io_queue_;
+  LocalQueue* local_queue_;
+  CancellationPool* cancel_pool_;
   TraceWriter* trace_;
+  PerfCounters* perf_;
 };
 
 }  // namespace sim
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+namespace sim::snap {
+
+// Low-level binary helpers shared by the snapshot save/load paths
+// (Workflow, LatencyEstimateStore, Controller). Fixed-width raw writes,
+// host endianness; snapshots are scratch artifacts for resuming sweeps on
+// the machine that produced them, not an interchange format.
+
+template <typename T>
+void Write(std::ostream& out, const T& v) {
+  static_assert(std::is_trivially_copyable_v<T>, "Write requires a trivially copyable type");
+  out.write(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+template <typename T>
+T Read(std::istream& in) {
+  static_assert(std::is_trivially_copyable_v<T>, "Read requires a trivially copyable type");
+  T v{};
+  in.read(reinterpret_cast<char*>(&v), sizeof(T));
+  if (!in) throw std::runtime_error("Snapshot: truncated stream");
+  return v;
+}
+
+inline void WriteString(std::ostream& out, const std::string& s) {
+  Write(out, static_cast<std::uint32_t>(s.size()));
+  out.write(s.data(), static_cast<std::streamsize>(s.size()));
+}
+
+inline std::string ReadString(std::istream& in) {
+  const auto len = Read<std::uint32_t>(in);
+  std::string s(len, '\0');
+  in.read(s.data(), static_cast<std::streamsize>(len));
+  if (!in) throw std::runtime_error("Snapshot: truncated stream");
+  return s;
+}
+
+}  // namespace sim::snap
@@ -0,0 +1,81 @@
+#include "sim/timer_wheel.h"
+
+#include <cmath>
+#include <utility>
+
+namespace sim {
+
+TimerWheel::TimerWheel(double start_ms)
+    : current_tick_(static_cast<std::uint64_t>(std::max(0.0, start_ms))) {}
+
+void TimerWheel::Schedule(double deadline_ms, TimerAction action) {
+  std::uint64_t expiry = current_tick_ + 1;
+  if (deadline_ms > static_cast<double>(current_tick_)) {
+    expiry = static_cast<std::uint64_t>(std::ceil(deadline_ms));
+  }
+  Insert(Entry{expiry, std::move(action)});
+  ++size_;
+}
+
+void TimerWheel::Insert(Entry entry) {
+  const std::uint64_t delta = entry.expiry_tick - current_tick_;
+  // Pick the finest level whose span covers the delta; deadlines beyond the
+  // wheel's total range park in the coarsest level and re-cascade.
+  int level = kLevels - 1;
+  for (int l = 0; l < kLevels; ++l) {
+    if (delta < (kSlotsPerLevel << (l * kBitsPerLevel))) {
+      level = l;
+      break;
+    }
+  }
+  const std::uint64_t slot =
+      (entry.expiry_tick >> (level * kBitsPerLevel)) & (kSlotsPerLevel - 1);
+  slots_[static_cast<std::size_t>(level)][slot].push_back(std::move(entry));
+}
+
+void TimerWheel::Cascade(int level, std::uint64_t slot, std::vector<TimerAction>& due) {
+  auto& bucket = slots_[static_cast<std::size_t>(level)][slot];
+  if (bucket.empty()) return;
+  std::vector<Entry> entries;
+  entries.swap(bucket);
+  for (Entry& entry : entries) {
+    if (entry.expiry_tick <= current_tick_) {
+      due.push_back(std::move(entry.action));
+      --size_;
+    } else {
+      Insert(std::move(entry));
+    }
+  }
+}
+
+void TimerWheel::AdvanceTo(double now_ms, std::vector<TimerAction>& due) {
+  const std::uint64_t target =
+      static_cast<std::uint64_t>(std::max(0.0, now_ms));
+  if (target <= current_tick_) return;
+  if (size_ == 0) {
+    // Nothing scheduled: jump straight to the target instead of stepping
+    // through empty slots (idle stretches in DES can span minutes).
+    current_tick_ = target;
+    return;
+  }
+  while (current_tick_ < target) {
+    ++current_tick_;
+    const std::uint64_t slot0 = current_tick_ & (kSlotsPerLevel - 1);
+    Cascade(0, slot0, due);
+    // When a level wraps, pull the next coarser slot's entries down.
+    if (slot0 == 0) {
+      for (int level = 1; level < kLevels; ++level) {
+        const std::uint64_t slot =
+            (current_tick_ >> (level * kBitsPerLevel)) & (kSlotsPerLevel - 1);
+        Cascade(level, slot, due);
+        if (slot != 0) break;
+      }
+    }
+    if (size_ == 0) {
+      current_tick_ = target;
+      return;
+    }
+  }
+}
+
+}  // namespace sim
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace sim {
+
+// Action fired when a timer expires. Invoked with the advance time and
+// returns units of follow-up work performed (e.g. attempts enqueued), so
+// engine ticks know whether queues need draining afterwards.
+using TimerAction = std::function<int(double now_ms)>;
+
+// Hierarchical timer wheel over milliseconds: four levels of 256 slots with
+// a 1 ms base tick, covering ~50 days of deadlines. Schedule is O(1);
+// advancing costs one slot check per elapsed millisecond plus amortized O(1)
+// per entry as coarse levels cascade, so deadline precision is ~1 ms at
+// constant cost regardless of how many timers are outstanding. Not
+// thread-safe; callers serialize access (the controller guards it with the
+// monitor's mutex).
+class TimerWheel {
+ public:
+  explicit TimerWheel(double start_ms = 0.0);
+
+  // Registers action to fire once deadline_ms has passed. Deadlines at or
+  // before the current time fire on the next Advance.
+  void Schedule(double deadline_ms, TimerAction action);
+
+  // Moves time forward to now_ms and collects every expired action into
+  // due (appended, not cleared): slots fire in time order, entries within a
+  // slot in registration order, so firing is deterministic. The caller
+  // invokes the actions after dropping its lock.
+  void AdvanceTo(double now_ms, std::vector<TimerAction>& due);
+
+  std::size_t size() const { return size_; }
+
+ private:
+  static constexpr int kLevels = 4;
+  static constexpr std::uint64_t kSlotsPerLevel = 256;
+  static constexpr int kBitsPerLevel = 8;
+
+  struct Entry {
+    std::uint64_t expiry_tick;
+    TimerAction action;
+  };
+
+  void Insert(Entry entry);
+  void Cascade(int level, std::uint64_t slot, std::vector<TimerAction>& due);
+
+  std::uint64_t current_tick_;
+  std::size_t size_ = 0;
+  std::array<std::array<std::vector<Entry>, kSlotsPerLevel>, kLevels> slots_;
+};
+
+}  // namespace sim
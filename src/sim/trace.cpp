@@ -1,6 +1,10 @@
 #include "sim/trace.h"
 
-#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
 
 namespace sim {
 
@@ -18,25 +22,133 @@ static const char* EventName(TraceEvent ev) {
   return "Unknown";
 }
 
-TraceWriter::TraceWriter(std::ostream& out) : out_(out) {
-  std::lock_guard lock(mutex_);
-  out_ << "[\n";
+TraceWriter::TraceWriter(const std::string& bin_path)
+    : out_(bin_path), writer_id_(NextWriterId()) {
+  TraceFileHeader header;
+  out_.Append(&header, sizeof(header));
+  flusher_ = std::thread(&TraceWriter::FlusherLoop, this);
 }
 
 TraceWriter::~TraceWriter() {
-  std::lock_guard lock(mutex_);
-  out_ << "\n]\n";
+  Close();
+}
+
+void TraceWriter::Close() {
+  {
+    std::lock_guard lock(flush_mutex_);
+    if (shutdown_) return;
+    shutdown_ = true;
+  }
+  flush_cv_.notify_one();
+  if (flusher_.joinable()) flusher_.join();
+  out_.Close();
+}
+
+// Monotonic id per writer. The thread-local cache below must not key on the
+// writer's address: after a writer is destroyed, a later writer can be
+// allocated at the same address (same size class), and a thread that emitted
+// through the old one would mistake its freed ring for current. Ids are
+// never reused, so a stale cache entry always misses.
+std::uint64_t TraceWriter::NextWriterId() {
+  static std::atomic<std::uint64_t> counter{0};
+  return counter.fetch_add(1) + 1;
+}
+
+TraceWriter::Ring* TraceWriter::RingForThisThread() {
+  thread_local std::uint64_t owner_id = 0;  // 0 never matches a real writer
+  thread_local Ring* ring = nullptr;
+  if (owner_id != writer_id_) {
+    auto fresh = std::make_unique<Ring>();
+    ring = fresh.get();
+    {
+      std::lock_guard lock(rings_mutex_);
+      rings_.push_back(std::move(fresh));
+    }
+    owner_id = writer_id_;
+  }
+  return ring;
 }
 
 void TraceWriter::Emit(TraceEvent ev, double time_ms, WorkflowId wf_id, NodeId node_id,
                       const std::string& extra) {
-  std::lock_guard lock(mutex_);
-  if (!first_) out_ << ",\n";
-  first_ = false;
-  out_ << "  {\"ev\":\"" << EventName(ev) << "\",\"t_ms\":" << time_ms << ",\"wf\":" << wf_id
-       << ",\"node\":" << node_id;
-  if (!extra.empty()) out_ << ",\"extra\":\"" << extra << "\"";
-  out_ << "}";
+  Ring* ring = RingForThisThread();
+  const std::uint64_t head = ring->head.load(std::memory_order_relaxed);
+  const std::uint64_t tail = ring->tail.load(std::memory_order_acquire);
+  if (head - tail >= Ring::kCapacity) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  TraceRecord& rec = ring->slots[head & (Ring::kCapacity - 1)];
+  rec.time_ms = time_ms;
+  rec.node_id = node_id;
+  rec.wf_id = wf_id;
+  rec.ev = static_cast<std::uint8_t>(ev);
+  std::memset(rec.extra, 0, sizeof(rec.extra));
+  std::memcpy(rec.extra, extra.data(), std::min(extra.size(), sizeof(rec.extra) - 1));
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+bool TraceWriter::DrainRing(Ring& ring) {
+  const std::uint64_t head = ring.head.load(std::memory_order_acquire);
+  std::uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+  if (tail == head) return false;
+  // At most two contiguous runs (the range may wrap the ring), each a single
+  // memcpy into the mapping.
+  while (tail != head) {
+    const std::size_t idx = static_cast<std::size_t>(tail & (Ring::kCapacity - 1));
+    const std::size_t run =
+        std::min<std::size_t>(static_cast<std::size_t>(head - tail), Ring::kCapacity - idx);
+    out_.Append(&ring.slots[idx], run * sizeof(TraceRecord));
+    tail += run;
+  }
+  ring.tail.store(tail, std::memory_order_release);
+  return true;
+}
+
+void TraceWriter::FlusherLoop() {
+  const auto interval = std::chrono::milliseconds(10);
+  bool done = false;
+  while (!done) {
+    {
+      std::unique_lock lock(flush_mutex_);
+      flush_cv_.wait_for(lock, interval, [this] { return shutdown_; });
+      done = shutdown_;
+    }
+    std::vector<Ring*> rings;
+    {
+      std::lock_guard lock(rings_mutex_);
+      rings.reserve(rings_.size());
+      for (const auto& r : rings_) rings.push_back(r.get());
+    }
+    for (Ring* ring : rings) DrainRing(*ring);
+  }
+}
+
+void ConvertTraceToJson(const std::string& bin_path, std::ostream& out) {
+  std::ifstream in(bin_path, std::ios::binary);
+  if (!in) {
+    throw std::runtime_error("ConvertTraceToJson: cannot open " + bin_path);
+  }
+  TraceFileHeader header;
+  in.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!in || std::memcmp(header.magic, "ASTR", 4) != 0 || header.version != 1 ||
+      header.record_size != sizeof(TraceRecord)) {
+    throw std::runtime_error("ConvertTraceToJson: incompatible trace file " + bin_path);
+  }
+
+  out << "[\n";
+  bool first = true;
+  TraceRecord rec;
+  while (in.read(reinterpret_cast<char*>(&rec), sizeof(rec))) {
+    if (!first) out << ",\n";
+    first = false;
+    out << "  {\"ev\":\"" << EventName(static_cast<TraceEvent>(rec.ev))
+        << "\",\"t_ms\":" << rec.time_ms << ",\"wf\":" << rec.wf_id
+        << ",\"node\":" << rec.node_id;
+    if (rec.extra[0] != '\0') out << ",\"extra\":\"" << rec.extra << "\"";
+    out << "}";
+  }
+  out << "\n]\n";
 }
 
 }  // namespace sim
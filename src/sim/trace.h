@@ -1,10 +1,17 @@
 #pragma once
 
+#include "sim/mapped_file.h"
 #include "sim/types.h"
 
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
 #include <mutex>
 #include <ostream>
 #include <string>
+#include <thread>
+#include <vector>
 
 namespace sim {
 
@@ -19,18 +26,78 @@ enum class TraceEvent {
   WorkflowDone,
 };
 
+// Fixed-size binary record appended on the hot path. The extra label
+// ("local", "hedge", "<provider>_<tier>", error strings) is truncated to fit;
+// all current labels are well under the limit.
+struct TraceRecord {
+  double time_ms = 0.0;
+  NodeId node_id = 0;
+  WorkflowId wf_id = 0;
+  std::uint8_t ev = 0;
+  char extra[19] = {};  // NUL-terminated
+};
+static_assert(sizeof(TraceRecord) == 40, "TraceRecord must stay fixed-size");
+
+// Header at the start of a binary trace file, so the converter can reject
+// files written by an incompatible build.
+struct TraceFileHeader {
+  char magic[4] = {'A', 'S', 'T', 'R'};
+  std::uint32_t version = 1;
+  std::uint32_t record_size = sizeof(TraceRecord);
+};
+
+// Records trace events as fixed-size binary records. Emit appends to a
+// per-thread ring buffer without taking a lock, so tracing costs a few
+// stores per event on the hot path; a background flusher thread drains the
+// rings into a memory-mapped file in contiguous runs, so persistence is
+// bounded by page-cache writeback. Events that arrive while a ring is full
+// are dropped and counted rather than blocking the emitter. Use
+// ConvertTraceToJson (the --convert subcommand) to rebuild the JSON trace
+// offline.
 class TraceWriter {
  public:
-  explicit TraceWriter(std::ostream& out);
+  explicit TraceWriter(const std::string& bin_path);
   ~TraceWriter();
 
   void Emit(TraceEvent ev, double time_ms, WorkflowId wf_id, NodeId node_id,
             const std::string& extra = "");
 
+  // Stops the flusher after a final drain and flushes the file. Idempotent;
+  // called automatically by the destructor.
+  void Close();
+
+  std::uint64_t dropped() const { return dropped_.load(); }
+
  private:
-  std::ostream& out_;
-  std::mutex mutex_;
-  bool first_ = true;
+  struct Ring {
+    static constexpr std::size_t kCapacity = 1 << 14;  // power of two
+    std::vector<TraceRecord> slots{kCapacity};
+    std::atomic<std::uint64_t> head{0};  // next write, advanced by the emitter
+    std::atomic<std::uint64_t> tail{0};  // next read, advanced by the flusher
+  };
+
+  static std::uint64_t NextWriterId();
+  Ring* RingForThisThread();
+  void FlusherLoop();
+  bool DrainRing(Ring& ring);
+
+  MappedFile out_;
+  // Unique across all writers ever constructed in the process; keys the
+  // per-thread ring cache, since a destroyed writer's address can be reused.
+  const std::uint64_t writer_id_;
+  std::mutex rings_mutex_;  // guards ring registration, not record traffic
+  std::vector<std::unique_ptr<Ring>> rings_;
+  std::atomic<std::uint64_t> dropped_{0};
+
+  std::thread flusher_;
+  std::mutex flush_mutex_;
+  std::condition_variable flush_cv_;
+  bool shutdown_ = false;
 };
 
+// Reads a binary trace produced by TraceWriter and writes the JSON array
+// format that TraceWriter used to emit directly. Throws std::runtime_error
+// if the file is missing or was written by an incompatible build.
+void ConvertTraceToJson(const std::string& bin_path, std::ostream& out);
+
 }  // namespace sim
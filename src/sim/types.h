@@ -1,9 +1,10 @@
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <cstdint>
+#include <deque>
 #include <string>
-#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -12,6 +13,13 @@ namespace sim {
 using WorkflowId = std::uint32_t;
 using NodeId = std::uint64_t;
 
+// Interned provider identifier, assigned once at config load. Hot paths
+// (dispatch, tier lookup, latency estimates) carry and compare this integer;
+// the provider's display name survives only in TierConfig for CSV/trace
+// output. Id 0 is reserved for local (non-provider) execution.
+using ProviderId = std::uint16_t;
+inline constexpr ProviderId kLocalProviderId = 0;
+
 enum class NodeType {
   Plan,
   LoadPDF,
@@ -30,6 +38,8 @@ enum class ResourceClass {
   llm,
 };
 
+inline constexpr std::size_t kNumResourceClasses = 4;
+
 enum class NodeState {
   WaitingDeps,
   Runnable,
@@ -48,8 +58,47 @@ inline bool IsActive(NodeState s) {
   return s == NodeState::Runnable || s == NodeState::Queued || s == NodeState::Running;
 }
 
+// Vector with inline storage for the first N elements, spilling to the heap
+// only past that. Most nodes have one or two edges, so adjacency lists live
+// inside the Node itself and graph walks stay cache-resident; iteration is
+// contiguous in either representation.
+template <typename T, std::size_t N>
+class SmallVector {
+ public:
+  void push_back(const T& v) {
+    if (spilled_) {
+      heap_.push_back(v);
+      return;
+    }
+    if (size_ < N) {
+      inline_[size_++] = v;
+      return;
+    }
+    heap_.reserve(N * 2);
+    heap_.assign(inline_.begin(), inline_.end());
+    heap_.push_back(v);
+    spilled_ = true;
+  }
+  void clear() {
+    size_ = 0;
+    heap_.clear();
+    spilled_ = false;
+  }
+  std::size_t size() const { return spilled_ ? heap_.size() : size_; }
+  bool empty() const { return size() == 0; }
+  const T* begin() const { return spilled_ ? heap_.data() : inline_.data(); }
+  const T* end() const { return begin() + size(); }
+  const T& operator[](std::size_t i) const { return begin()[i]; }
+
+ private:
+  std::array<T, N> inline_{};
+  std::vector<T> heap_;
+  std::size_t size_ = 0;
+  bool spilled_ = false;
+};
+
 struct ExecutionOption {
-  std::string provider;
+  ProviderId provider_id = kLocalProviderId;
   int tier_id = 0;
   double price_per_call = 0.0;
   int timeout_ms = 0;
@@ -74,8 +123,12 @@ struct Node {
   int subquery_idx = -1;
 
   // Dependency edges in the DAG (node IDs within the same workflow).
-  std::vector<NodeId> deps;
-  std::vector<NodeId> children;
+  SmallVector<NodeId, 4> deps;
+  SmallVector<NodeId, 4> children;
+
+  // Count of deps that have not yet Succeeded; maintained by Workflow so
+  // readiness checks are O(1) instead of re-walking deps.
+  int unmet_deps = 0;
 
   // Used by later scheduling policies; populated for provider-backed node types.
   std::vector<ExecutionOption> preference_list;
@@ -85,8 +138,11 @@ struct Node {
   int evidence_count_est = 0;
 };
 
+// Node ids are dense and sequential from 1, so nodes live contiguously in a
+// deque arena indexed by id - 1: lookups are an index, not a hash probe, and
+// references stay stable as iterations expand the graph.
 struct WorkflowGraph {
-  std::unordered_map<NodeId, Node> nodes;
+  std::deque<Node> nodes;
   NodeId next_node_id = 1;
 };
 
@@ -6,34 +6,66 @@
 
 namespace sim {
 
+ResultQueue::~ResultQueue() {
+  ResultNode* node = head_.exchange(nullptr, std::memory_order_acquire);
+  while (node) {
+    ResultNode* next = node->next;
+    delete node;
+    node = next;
+  }
+}
+
 void ResultQueue::Push(AttemptResult r) {
-  {
-    std::lock_guard lock(mutex_);
-    if (shutdown_.load()) return;
-    queue_.push(std::move(r));
+  if (shutdown_.load()) return;
+  auto* node = new ResultNode{std::move(r), nullptr};
+  node->next = head_.load(std::memory_order_relaxed);
+  while (!head_.compare_exchange_weak(node->next, node, std::memory_order_release,
+                                      std::memory_order_relaxed)) {
+  }
+  // Wake the consumer only if one is actually parked; the brief lock closes
+  // the check-then-sleep race in WaitForResult.
+  if (waiters_.load(std::memory_order_acquire) > 0) {
+    { std::lock_guard lock(wait_mutex_); }
+    wait_cv_.notify_one();
   }
-  cv_.notify_one();
 }
 
-bool ResultQueue::TryPop(AttemptResult& out) {
-  std::lock_guard lock(mutex_);
-  if (queue_.empty() || shutdown_.load()) return false;
-  out = std::move(queue_.front());
-  queue_.pop();
-  return true;
+void ResultQueue::DrainAll(std::vector<AttemptResult>& out) {
+  out.clear();
+  ResultNode* node = head_.exchange(nullptr, std::memory_order_acquire);
+  // The list is newest-first; reverse to hand results out in arrival order.
+  ResultNode* reversed = nullptr;
+  while (node) {
+    ResultNode* next = node->next;
+    node->next = reversed;
+    reversed = node;
+    node = next;
+  }
+  while (reversed) {
+    out.push_back(std::move(reversed->result));
+    ResultNode* next = reversed->next;
+    delete reversed;
+    reversed = next;
+  }
 }
 
-void ResultQueue::BlockingPop(AttemptResult& out) {
-  std::unique_lock lock(mutex_);
-  cv_.wait(lock, [this] { return !queue_.empty() || shutdown_.load(); });
-  if (shutdown_.load() && queue_.empty()) return;
-  out = std::move(queue_.front());
-  queue_.pop();
+bool ResultQueue::WaitForResult(std::chrono::milliseconds timeout) {
+  if (head_.load(std::memory_order_acquire) != nullptr) return true;
+  waiters_.fetch_add(1);
+  {
+    std::unique_lock lock(wait_mutex_);
+    wait_cv_.wait_for(lock, timeout, [this] {
+      return head_.load(std::memory_order_acquire) != nullptr || shutdown_.load();
+    });
+  }
+  waiters_.fetch_sub(1);
+  return head_.load(std::memory_order_acquire) != nullptr;
 }
 
 void ResultQueue::Shutdown() {
   shutdown_.store(true);
-  cv_.notify_all();
+  { std::lock_guard lock(wait_mutex_); }
+  wait_cv_.notify_all();
 }
 
 void LocalQueue::Push(LocalTask t) {
@@ -43,6 +75,11 @@ void LocalQueue::Push(LocalTask t) {
     queue_.push(std::move(t));
   }
   cv_.notify_one();
+  if (enqueue_listener_) enqueue_listener_();
+}
+
+void LocalQueue::SetEnqueueListener(std::function<void()> listener) {
+  enqueue_listener_ = std::move(listener);
 }
 
 bool LocalQueue::TryPop(LocalTask& out) {
@@ -53,43 +90,13 @@ bool LocalQueue::TryPop(LocalTask& out) {
   return true;
 }
 
-void LocalQueue::BlockingPop(LocalTask& out) {
-  std::unique_lock lock(mutex_);
-  cv_.wait(lock, [this] { return !queue_.empty() || shutdown_.load(); });
-  if (shutdown_.load() && queue_.empty()) return;
-  out = std::move(queue_.front());
-  queue_.pop();
-}
-
-bool LocalQueue::TimedPop(LocalTask& out, std::chrono::milliseconds timeout) {
-  std::unique_lock lock(mutex_);
-  bool ok = cv_.wait_for(lock, timeout, [this] { return !queue_.empty() || shutdown_.load(); });
-  if (!ok || (shutdown_.load() && queue_.empty())) return false;
-  out = std::move(queue_.front());
-  queue_.pop();
-  return true;
-}
-
 void LocalQueue::Shutdown() {
   shutdown_.store(true);
   cv_.notify_all();
 }
 
-bool CancellableSleep(std::chrono::milliseconds total, std::atomic<bool>* cancelled,
-                     int chunk_ms) {
-  const auto chunk = std::chrono::milliseconds(std::max(1, chunk_ms));
-  auto remaining = total;
-  while (remaining.count() > 0) {
-    if (cancelled && cancelled->load()) return true;
-    const auto sleep_time = std::min(remaining, chunk);
-    std::this_thread::sleep_for(sleep_time);
-    remaining -= sleep_time;
-  }
-  return cancelled && cancelled->load();
-}
-
-static double SampleLocalServiceTime(NodeType type, const LatencyContext& ctx,
-                                     const LatencyConfig& config, SeededRng* rng) {
+double SampleLocalServiceTime(NodeType type, const LatencyContext& ctx,
+                              const LatencyConfig& config, SeededRng* rng) {
   const LatencyParams& params = config.Get(type);
   double raw = 0.0;
   switch (params.dist) {
@@ -119,93 +126,175 @@ static double SampleLocalServiceTime(NodeType type, const LatencyContext& ctx,
   return std::max(1.0, raw);
 }
 
-void TierWorkerLoop(Tier* tier, LatencySampler* sampler, SeededRng* rng, ResultQueue* results,
-                    int time_scale, std::atomic<bool>* shutdown,
-                    double heavy_tail_prob, double heavy_tail_multiplier) {
-  while (!shutdown || !shutdown->load()) {
+// -----------------------------------------------------------------------------
+// AttemptExecutor
+// -----------------------------------------------------------------------------
+
+AttemptExecutor::AttemptExecutor(ProviderManager* provider_mgr, LocalQueue* local_queue,
+                                 LatencySampler* sampler, SeededRng* rng,
+                                 const LatencyConfig& latency_config, ResultQueue* results,
+                                 int time_scale, double heavy_tail_prob,
+                                 double heavy_tail_multiplier, ReplayLog* replay_log,
+                                 ReplaySource* replay_source)
+    : provider_mgr_(provider_mgr),
+      local_queue_(local_queue),
+      sampler_(sampler),
+      rng_(rng),
+      latency_config_(latency_config),
+      results_(results),
+      time_scale_(time_scale),
+      heavy_tail_prob_(heavy_tail_prob),
+      heavy_tail_multiplier_(heavy_tail_multiplier),
+      replay_log_(replay_log),
+      replay_source_(replay_source),
+      local_slots_(static_cast<int>(std::max(6u, std::thread::hardware_concurrency()))) {}
+
+AttemptExecutor::~AttemptExecutor() {
+  Shutdown();
+}
+
+void AttemptExecutor::Start() {
+  for (const auto& tier_ptr : provider_mgr_->tiers()) {
+    tier_ptr->SetEnqueueListener([this] { Wake(); });
+  }
+  local_queue_->SetEnqueueListener([this] { Wake(); });
+  thread_ = std::thread(&AttemptExecutor::Loop, this);
+}
+
+void AttemptExecutor::Shutdown() {
+  shutdown_.store(true);
+  Wake();
+  if (thread_.joinable()) thread_.join();
+}
+
+void AttemptExecutor::Wake() {
+  {
+    std::lock_guard lock(mutex_);
+    wake_pending_ = true;
+  }
+  cv_.notify_one();
+}
+
+void AttemptExecutor::StartReadyAttempts() {
+  const auto now = std::chrono::steady_clock::now();
+
+  for (const auto& tier_ptr : provider_mgr_->tiers()) {
+    Tier* tier = tier_ptr.get();
     QueuedAttempt attempt;
-    if (!tier->TimedDequeue(attempt, std::chrono::milliseconds(100))) continue;
+    while (tier->TryDequeueWithTokens(attempt)) {
+      const TierConfig& tc = tier->config();
+      LatencySample sample;
+      if (!replay_source_ ||
+          !replay_source_->Next(attempt.workflow_id, attempt.node_id, &sample)) {
+        sample = sampler_->Sample(attempt.latency_ctx, attempt.timeout_ms, tc.p_fail);
+        if (heavy_tail_prob_ > 0.0 && rng_ && rng_->Bernoulli(heavy_tail_prob_)) {
+          sample.service_time_ms *= heavy_tail_multiplier_;
+        }
+      }
+      if (replay_log_) replay_log_->Record(attempt.workflow_id, attempt.node_id, sample);
+      const int scaled_ms = std::max(1, static_cast<int>(sample.service_time_ms) / time_scale_);
 
-    tier->AcquireTokens(attempt);
+      InFlight fl;
+      fl.start = now;
+      fl.deadline = now + std::chrono::milliseconds(scaled_ms);
+      fl.sample_failed = sample.failed;
+      fl.sample_timeout = sample.timeout;
+      fl.cancelled = attempt.cancelled;
+      fl.tier = tier;
+      fl.result.node_id = attempt.node_id;
+      fl.result.workflow_id = attempt.workflow_id;
+      fl.result.attempt_id = attempt.attempt_id;
+      fl.result.provider_id = attempt.provider_id;
+      fl.result.tier_id = attempt.tier_id;
+      fl.result.cost = tc.price_per_call;
+      in_flight_.push_back(std::move(fl));
+    }
+  }
 
-    const auto start = std::chrono::steady_clock::now();
-    const TierConfig& tc = tier->config();
-    LatencySample sample = sampler->Sample(attempt.latency_ctx, attempt.timeout_ms, tc.p_fail);
-    if (heavy_tail_prob > 0.0 && rng && rng->Bernoulli(heavy_tail_prob)) {
-      sample.service_time_ms *= heavy_tail_multiplier;
+  LocalTask task;
+  while (local_slots_ > 0 && local_queue_->TryPop(task)) {
+    --local_slots_;
+    LatencySample local_sample;
+    if (!replay_source_ || !replay_source_->Next(task.workflow_id, task.node_id, &local_sample)) {
+      local_sample.service_time_ms =
+          SampleLocalServiceTime(task.node_type, task.latency_ctx, latency_config_, rng_);
+      if (heavy_tail_prob_ > 0.0 && rng_ && rng_->Bernoulli(heavy_tail_prob_)) {
+        local_sample.service_time_ms *= heavy_tail_multiplier_;
+      }
     }
+    if (replay_log_) replay_log_->Record(task.workflow_id, task.node_id, local_sample);
+    const double raw_ms = local_sample.service_time_ms;
+    const int scaled_ms = std::max(1, static_cast<int>(raw_ms) / time_scale_);
 
-    const int scaled_ms = std::max(1, static_cast<int>(sample.service_time_ms) / time_scale);
-    const bool cancelled =
-        CancellableSleep(std::chrono::milliseconds(scaled_ms), attempt.cancelled, 20);
+    InFlight fl;
+    fl.start = now;
+    fl.deadline = now + std::chrono::milliseconds(scaled_ms);
+    fl.cancelled = task.cancelled;
+    fl.local_slots = &local_slots_;
+    fl.result.node_id = task.node_id;
+    fl.result.workflow_id = task.workflow_id;
+    fl.result.attempt_id = task.attempt_id;
+    fl.result.provider_id = kLocalProviderId;
+    fl.result.tier_id = static_cast<int>(task.resource_class);
+    fl.result.cost = 0.0;
+    in_flight_.push_back(std::move(fl));
+  }
+}
 
-    const auto end = std::chrono::steady_clock::now();
-    const double duration_ms =
-        std::chrono::duration<double, std::milli>(end - start).count() * time_scale;
+std::chrono::steady_clock::time_point AttemptExecutor::CompleteDueAttempts() {
+  const auto now = std::chrono::steady_clock::now();
+  auto next_deadline = now + std::chrono::hours(24);
 
-    AttemptResult res;
-    res.node_id = attempt.node_id;
-    res.workflow_id = attempt.workflow_id;
-    res.attempt_id = attempt.attempt_id;
-    res.provider = attempt.provider;
-    res.tier_id = attempt.tier_id;
-    res.duration_ms = duration_ms;
-    res.cost = tc.price_per_call;
+  for (std::size_t i = 0; i < in_flight_.size();) {
+    InFlight& fl = in_flight_[i];
+    const bool cancelled = fl.cancelled.IsCancelled();
+    const bool due = now >= fl.deadline;
+    if (!cancelled && !due) {
+      if (fl.deadline < next_deadline) next_deadline = fl.deadline;
+      ++i;
+      continue;
+    }
 
+    AttemptResult res = std::move(fl.result);
+    res.duration_ms =
+        std::chrono::duration<double, std::milli>(now - fl.start).count() * time_scale_;
     if (cancelled) {
       res.success = false;
       res.error = "cancelled";
-    } else if (sample.failed) {
+    } else if (fl.sample_failed) {
       res.success = false;
       res.error = "failed";
-    } else if (sample.timeout) {
+    } else if (fl.sample_timeout) {
       res.success = false;
       res.error = "timeout";
     } else {
       res.success = true;
     }
 
-    tier->OnAttemptFinish();
-    results->Push(std::move(res));
+    if (fl.tier) fl.tier->OnAttemptFinish();
+    if (fl.local_slots) ++(*fl.local_slots);
+    in_flight_[i] = std::move(in_flight_.back());
+    in_flight_.pop_back();
+    results_->Push(std::move(res));
   }
+  return next_deadline;
 }
 
-void LocalWorkerLoop(LocalQueue* queue, ResourceClass resource_class, LatencySampler* sampler,
-                    SeededRng* rng, ResultQueue* results, const LatencyConfig& latency_config,
-                    int time_scale, std::atomic<bool>* shutdown,
-                    double heavy_tail_prob, double heavy_tail_multiplier) {
-  (void)sampler;
-  while (!shutdown || !shutdown->load()) {
-    LocalTask task;
-    if (!queue->TimedPop(task, std::chrono::milliseconds(100))) continue;
-
-    double raw_ms = SampleLocalServiceTime(task.node_type, task.latency_ctx, latency_config, rng);
-    if (heavy_tail_prob > 0.0 && rng && rng->Bernoulli(heavy_tail_prob)) {
-      raw_ms *= heavy_tail_multiplier;
-    }
-    const int scaled_ms = std::max(1, static_cast<int>(raw_ms) / time_scale);
-    const bool cancelled =
-        CancellableSleep(std::chrono::milliseconds(scaled_ms), task.cancelled, 20);
-
-    const double duration_ms = raw_ms;
-
-    AttemptResult res;
-    res.node_id = task.node_id;
-    res.workflow_id = task.workflow_id;
-    res.attempt_id = task.attempt_id;
-    res.provider = "local";
-    res.tier_id = static_cast<int>(resource_class);
-    res.duration_ms = duration_ms;
-    res.cost = 0.0;
-
-    if (cancelled) {
-      res.success = false;
-      res.error = "cancelled";
-    } else {
-      res.success = true;
-    }
+void AttemptExecutor::Loop() {
+  // Wake-ups are capped at 20 ms so cancellations and token refills are
+  // observed promptly even with no due deadline, matching the granularity of
+  // the former per-thread CancellableSleep.
+  const auto max_wait = std::chrono::milliseconds(20);
+  while (!shutdown_.load()) {
+    StartReadyAttempts();
+    const auto next_deadline = CompleteDueAttempts();
 
-    results->Push(std::move(res));
+    std::unique_lock lock(mutex_);
+    if (shutdown_.load()) break;
+    const auto cap = std::chrono::steady_clock::now() + max_wait;
+    cv_.wait_until(lock, std::min(next_deadline, cap),
+                   [this] { return wake_pending_ || shutdown_.load(); });
+    wake_pending_ = false;
   }
 }
 
@@ -3,6 +3,7 @@
 #include "sim/config.h"
 #include "sim/provider.h"
 #include "sim/random.h"
+#include "sim/replay.h"
 #include "sim/types.h"
 
 #include <atomic>
@@ -14,6 +15,7 @@
 #include <queue>
 #include <string>
 #include <thread>
+#include <vector>
 
 namespace sim {
 
@@ -24,25 +26,41 @@ struct AttemptResult {
   bool success = false;
   double duration_ms = 0.0;
   double cost = 0.0;
-  std::string provider;
+  ProviderId provider_id = kLocalProviderId;
   int tier_id = 0;
   std::string error;  // "timeout", "failed", "cancelled"
 };
 
-// Thread-safe queue for results from workers to controller.
+// Lock-free MPSC queue for results from the executor to the controller.
+// Producers push onto an atomic intrusive list with a CAS; the single
+// consumer exchanges the whole list out and reverses it, so neither side
+// ever blocks the other. The mutex below exists only to park the consumer
+// in WaitForResult and is touched by producers only when a waiter is parked.
 class ResultQueue {
  public:
+  ~ResultQueue();
+
   void Push(AttemptResult r);
-  bool TryPop(AttemptResult& out);
-  void BlockingPop(AttemptResult& out);
+  // Moves every queued result into out (cleared first), oldest first.
+  void DrainAll(std::vector<AttemptResult>& out);
+  // Blocks until a result is available, shutdown, or the timeout elapses.
+  // Returns true if the queue is non-empty. Lets the controller react to a
+  // completion immediately instead of polling on a fixed interval.
+  bool WaitForResult(std::chrono::milliseconds timeout);
   void Shutdown();
   bool IsShutdown() const { return shutdown_.load(); }
 
  private:
-  std::queue<AttemptResult> queue_;
-  mutable std::mutex mutex_;
-  std::condition_variable cv_;
+  struct ResultNode {
+    AttemptResult result;
+    ResultNode* next = nullptr;
+  };
+
+  std::atomic<ResultNode*> head_{nullptr};  // newest first
   std::atomic<bool> shutdown_{false};
+  std::atomic<int> waiters_{0};
+  std::mutex wait_mutex_;
+  std::condition_variable wait_cv_;
 };
 
 // Local task for cpu/io resource classes (no provider tier).
@@ -54,40 +72,92 @@ struct LocalTask {
   LatencyContext latency_ctx;
   int timeout_ms = 5000;
   AttemptId attempt_id = 0;
-  std::atomic<bool>* cancelled = nullptr;
+  CancellationToken cancelled;
 };
 
-// Thread-safe local task queue.
+// Thread-safe queue for cpu/io tasks. A single queue serves both resource
+// classes — ResourceClass travels on the task as a tag — so a burst of one
+// class can use the whole local slot pool instead of backing up behind a
+// hard partition.
 class LocalQueue {
  public:
   void Push(LocalTask t);
   bool TryPop(LocalTask& out);
-  void BlockingPop(LocalTask& out);
-  bool TimedPop(LocalTask& out, std::chrono::milliseconds timeout);
   void Shutdown();
   bool IsShutdown() const { return shutdown_.load(); }
+  // Invoked (without the queue lock) after each Push; see Tier.
+  void SetEnqueueListener(std::function<void()> listener);
 
  private:
   std::queue<LocalTask> queue_;
   mutable std::mutex mutex_;
   std::condition_variable cv_;
   std::atomic<bool> shutdown_{false};
+  std::function<void()> enqueue_listener_;
 };
 
-// Runs worker loop for a provider tier. Exits when shutdown is true.
-// heavy_tail_prob: if > 0, this fraction of tasks get service_time *= heavy_tail_multiplier.
-void TierWorkerLoop(Tier* tier, LatencySampler* sampler, SeededRng* rng, ResultQueue* results,
-                    int time_scale, std::atomic<bool>* shutdown,
-                    double heavy_tail_prob = 0.0, double heavy_tail_multiplier = 1.0);
-
-// Runs worker loop for local cpu or io queue.
-void LocalWorkerLoop(LocalQueue* queue, ResourceClass resource_class, LatencySampler* sampler,
-                    SeededRng* rng, ResultQueue* results, const LatencyConfig& latency_config,
-                    int time_scale, std::atomic<bool>* shutdown,
-                    double heavy_tail_prob = 0.0, double heavy_tail_multiplier = 1.0);
-
-// Sleep in chunks, checking cancellation flag. Returns true if cancelled.
-bool CancellableSleep(std::chrono::milliseconds total, std::atomic<bool>* cancelled,
-                      int chunk_ms = 20);
+// Samples service time for a local (cpu/io) task. Shared between the
+// executor and the discrete-event engine.
+double SampleLocalServiceTime(NodeType type, const LatencyContext& ctx,
+                              const LatencyConfig& config, SeededRng* rng);
+
+// Timer-driven execution of in-flight attempts for the real-time engine.
+// One dispatcher thread pulls work from tier and local queues, samples the
+// service time, and parks the attempt in a deadline list; a due or cancelled
+// attempt costs a list entry, not a sleeping thread, so tier concurrency caps
+// in the thousands are cheap.
+class AttemptExecutor {
+ public:
+  AttemptExecutor(ProviderManager* provider_mgr, LocalQueue* local_queue,
+                  LatencySampler* sampler, SeededRng* rng, const LatencyConfig& latency_config,
+                  ResultQueue* results, int time_scale, double heavy_tail_prob,
+                  double heavy_tail_multiplier, ReplayLog* replay_log = nullptr,
+                  ReplaySource* replay_source = nullptr);
+  ~AttemptExecutor();
+
+  void Start();
+  void Shutdown();
+
+ private:
+  struct InFlight {
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point deadline;
+    AttemptResult result;  // outcome fields prefilled at start
+    bool sample_failed = false;
+    bool sample_timeout = false;
+    CancellationToken cancelled;
+    Tier* tier = nullptr;          // non-null for tier attempts
+    int* local_slots = nullptr;    // non-null for local tasks
+  };
+
+  void Loop();
+  void StartReadyAttempts();
+  // Finalizes due and cancelled attempts; returns the earliest remaining
+  // deadline, or a far-future time point when nothing is in flight.
+  std::chrono::steady_clock::time_point CompleteDueAttempts();
+  void Wake();
+
+  ProviderManager* provider_mgr_;
+  LocalQueue* local_queue_;
+  LatencySampler* sampler_;
+  SeededRng* rng_;
+  const LatencyConfig& latency_config_;
+  ResultQueue* results_;
+  int time_scale_;
+  double heavy_tail_prob_;
+  double heavy_tail_multiplier_;
+  ReplayLog* replay_log_;
+  ReplaySource* replay_source_;
+
+  // Unified local capacity sized to the host; cpu and io tasks share it.
+  int local_slots_;
+  std::vector<InFlight> in_flight_;
+
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool wake_pending_ = false;
+  std::atomic<bool> shutdown_{false};
+};
 
 }  // namespace sim
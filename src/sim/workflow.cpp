@@ -1,5 +1,7 @@
 #include "sim/workflow.h"
 
+#include "sim/snapshot.h"
+
 #include <algorithm>
 #include <cmath>
 #include <stdexcept>
@@ -23,20 +25,19 @@ Workflow::Workflow(WorkflowId id, WorkloadParams params, const ProviderConfig* p
   if (params_.pdfs <= 0) throw std::runtime_error("WorkloadParams.pdfs must be > 0");
   if (params_.subqueries_per_iter < 0) throw std::runtime_error("WorkloadParams.subqueries_per_iter must be >= 0");
   if (params_.max_iters <= 0) throw std::runtime_error("WorkloadParams.max_iters must be > 0");
+  expanded_iters_.resize(static_cast<std::size_t>(params_.max_iters), false);
+  BuildPreferenceTemplates();
   EnsureInitialPlan();
-  RefreshRunnable();
 }
 
 const Node& Workflow::node(NodeId nid) const {
-  auto it = graph_.nodes.find(nid);
-  if (it == graph_.nodes.end()) throw std::runtime_error("Unknown node id");
-  return it->second;
+  if (nid == 0 || nid > graph_.nodes.size()) throw std::runtime_error("Unknown node id");
+  return graph_.nodes[nid - 1];
 }
 
 Node& Workflow::node_mut(NodeId nid) {
-  auto it = graph_.nodes.find(nid);
-  if (it == graph_.nodes.end()) throw std::runtime_error("Unknown node id");
-  return it->second;
+  if (nid == 0 || nid > graph_.nodes.size()) throw std::runtime_error("Unknown node id");
+  return graph_.nodes[nid - 1];
 }
 
 NodeId Workflow::NewNodeId() {
@@ -46,9 +47,13 @@ NodeId Workflow::NewNodeId() {
 Node& Workflow::AddNode(Node n) {
   if (n.id == 0) n.id = NewNodeId();
   if (n.workflow_id == 0) n.workflow_id = id_;
-  auto [it, inserted] = graph_.nodes.emplace(n.id, std::move(n));
-  if (!inserted) throw std::runtime_error("Duplicate node id");
-  return it->second;
+  // The arena is indexed by id - 1, so ids must arrive densely in order.
+  if (n.id != graph_.nodes.size() + 1) throw std::runtime_error("Node ids must be dense");
+  graph_.nodes.push_back(std::move(n));
+  Node& added = graph_.nodes.back();
+  ++change_epoch_;
+  if (added.state == NodeState::Runnable) runnable_set_.insert(added.id);
+  return added;
 }
 
 void Workflow::AddEdge(NodeId from, NodeId to) {
@@ -56,20 +61,28 @@ void Workflow::AddEdge(NodeId from, NodeId to) {
   Node& b = node_mut(to);
   a.children.push_back(to);
   b.deps.push_back(from);
+  if (a.state != NodeState::Succeeded) {
+    ++b.unmet_deps;
+    if (b.state == NodeState::Runnable) {
+      b.state = NodeState::WaitingDeps;
+      runnable_set_.erase(to);
+    }
+  }
 }
 
 bool Workflow::DepsSatisfied(const Node& n) const {
-  for (NodeId d : n.deps) {
-    const Node& dep = node(d);
-    if (dep.state != NodeState::Succeeded) return false;
-  }
-  return true;
+  return n.unmet_deps == 0;
 }
 
 void Workflow::InitializeStateFromDeps(NodeId nid) {
   Node& n = node_mut(nid);
   if (IsTerminal(n.state)) return;
   n.state = DepsSatisfied(n) ? NodeState::Runnable : NodeState::WaitingDeps;
+  if (n.state == NodeState::Runnable) {
+    runnable_set_.insert(nid);
+  } else {
+    runnable_set_.erase(nid);
+  }
 }
 
 void Workflow::SetState(NodeId nid, NodeState next) {
@@ -111,33 +124,22 @@ void Workflow::SetState(NodeId nid, NodeState next) {
       break;
   }
 
-  n.state = next;
-}
-
-std::vector<NodeId> Workflow::RefreshRunnable() {
-  std::vector<NodeId> newly;
-  newly.reserve(graph_.nodes.size());
+  const bool was_in_flight = (n.state == NodeState::Queued || n.state == NodeState::Running);
+  const bool now_in_flight = (next == NodeState::Queued || next == NodeState::Running);
+  if (now_in_flight && !was_in_flight) ++in_flight_count_;
+  if (was_in_flight && !now_in_flight) --in_flight_count_;
 
-  for (auto& [nid, n] : graph_.nodes) {
-    if (IsTerminal(n.state) || n.state == NodeState::Queued || n.state == NodeState::Running) continue;
-    const bool ready = DepsSatisfied(n);
-    if (ready && n.state != NodeState::Runnable) {
-      n.state = NodeState::Runnable;
-      newly.push_back(nid);
-    } else if (!ready && n.state != NodeState::WaitingDeps) {
-      n.state = NodeState::WaitingDeps;
-    }
+  n.state = next;
+  if (next == NodeState::Runnable) {
+    runnable_set_.insert(nid);
+  } else {
+    runnable_set_.erase(nid);
   }
-
-  return newly;
+  if (IsTerminal(next)) ++change_epoch_;
 }
 
 std::vector<NodeId> Workflow::RunnableNodes() const {
-  std::vector<NodeId> out;
-  out.reserve(graph_.nodes.size());
-  for (const auto& [nid, n] : graph_.nodes) {
-    if (n.state == NodeState::Runnable) out.push_back(nid);
-  }
+  std::vector<NodeId> out(runnable_set_.begin(), runnable_set_.end());
   std::sort(out.begin(), out.end());
   return out;
 }
@@ -156,14 +158,22 @@ void Workflow::MarkSucceeded(NodeId nid) {
 
   SetState(nid, NodeState::Succeeded);
 
+  // Decrement unsatisfied-dependency counters on children; any that hit zero
+  // become runnable. This replaces the former full-graph RefreshRunnable scan.
+  const auto children = node(nid).children;
+  for (NodeId cid : children) {
+    Node& c = node_mut(cid);
+    if (--c.unmet_deps == 0 && c.state == NodeState::WaitingDeps) {
+      SetState(cid, NodeState::Runnable);
+    }
+  }
+
   if (t == NodeType::Plan) {
     ExpandIterationFromPlan(nid);
   } else if (t == NodeType::DecideNext) {
     OnDecideNext(nid);
     completed_iters_ = std::max(completed_iters_, iter + 1);
   }
-
-  RefreshRunnable();
 }
 
 void Workflow::MarkFailed(NodeId nid) {
@@ -174,28 +184,25 @@ void Workflow::MarkFailed(NodeId nid) {
   done_ = true;
   stop_iter_ = iter;
   PruneAfterStop(iter);
-
-  RefreshRunnable();
 }
 
 void Workflow::Retry(NodeId nid) {
   SetState(nid, NodeState::Runnable);
-  RefreshRunnable();
 }
 
 void Workflow::Cancel(NodeId nid) {
   Node& n = node_mut(nid);
   if (IsTerminal(n.state)) return;
-  n.state = NodeState::Cancelled;
-  RefreshRunnable();
+  SetState(nid, NodeState::Cancelled);
 }
 
 void Workflow::PruneAfterStop(int stop_iter) {
-  for (auto& [nid, n] : graph_.nodes) {
+  // Pruning is rare (once per workflow at stop/failure), so a full pass here
+  // is acceptable; steady-state transitions stay scan-free.
+  for (const Node& n : graph_.nodes) {
     if (IsTerminal(n.state)) continue;
-    if (n.iter > stop_iter) n.state = NodeState::Cancelled;
+    if (n.iter > stop_iter) SetState(n.id, NodeState::Cancelled);
   }
-  RefreshRunnable();
 }
 
 void Workflow::EnsureInitialPlan() {
@@ -230,14 +237,16 @@ static ResourceClass ResourceForType(NodeType t) {
 }
 
 void Workflow::ExpandIterationFromPlan(NodeId plan_node) {
-  const Node& plan = node(plan_node);
-  const int iter = plan.iter;
+  const int iter = node(plan_node).iter;
   if (iter >= params_.max_iters) return;
 
   // Guard against double-expansion (e.g., if controller replays success).
-  for (const auto& [nid, n] : graph_.nodes) {
-    if (n.type == NodeType::Aggregate && n.iter == iter) return;
-  }
+  if (expanded_iters_[static_cast<std::size_t>(iter)]) return;
+  expanded_iters_[static_cast<std::size_t>(iter)] = true;
+
+  // Only the per-pdf load nodes start runnable; size the ready-set up front
+  // so the whole burst inserts without rehashing.
+  runnable_set_.reserve(runnable_set_.size() + static_cast<std::size_t>(params_.pdfs));
 
   std::vector<NodeId> extract_nodes;
   extract_nodes.reserve(static_cast<std::size_t>(params_.pdfs) *
@@ -286,6 +295,10 @@ void Workflow::ExpandIterationFromPlan(NodeId plan_node) {
     AddEdge(load_id, chunk_id);
     AddEdge(chunk_id, embed_id);
 
+    InitializeStateFromDeps(load_id);
+    InitializeStateFromDeps(chunk_id);
+    InitializeStateFromDeps(embed_id);
+
     const int K = params_.subqueries_per_iter;
     if (K == 0) continue;
 
@@ -325,6 +338,8 @@ void Workflow::ExpandIterationFromPlan(NodeId plan_node) {
 
       AddEdge(embed_id, ss_id);
       AddEdge(ss_id, ex_id);
+      InitializeStateFromDeps(ss_id);
+      InitializeStateFromDeps(ex_id);
       extract_nodes.push_back(ex_id);
     }
   }
@@ -366,7 +381,7 @@ void Workflow::ExpandIterationFromPlan(NodeId plan_node) {
 
 int Workflow::IterEvidenceTotal(int iter) const {
   int total = 0;
-  for (const auto& [nid, n] : graph_.nodes) {
+  for (const Node& n : graph_.nodes) {
     if (n.iter == iter && n.type == NodeType::ExtractEvidence) total += n.evidence_count_est;
   }
   return total;
@@ -375,7 +390,7 @@ int Workflow::IterEvidenceTotal(int iter) const {
 int Workflow::IterPdfCoverageCount(int iter) const {
   std::unordered_set<int> covered;
   covered.reserve(static_cast<std::size_t>(params_.pdfs));
-  for (const auto& [nid, n] : graph_.nodes) {
+  for (const Node& n : graph_.nodes) {
     if (n.iter != iter || n.type != NodeType::ExtractEvidence) continue;
     if (n.evidence_count_est > 0) covered.insert(n.pdf_idx);
   }
@@ -402,32 +417,35 @@ DecideAction Workflow::ComputeDecideAction(int iter) const {
   return (strong || borderline) ? DecideAction::Stop : DecideAction::Continue;
 }
 
-void Workflow::PopulatePreferenceListForNode(Node& n) {
+void Workflow::BuildPreferenceTemplates() {
   if (!provider_config_) return;
-  n.preference_list.clear();
   for (const auto& tc : provider_config_->tiers) {
-    if (n.resource_class == ResourceClass::embed && tc.provider == "embed_provider") {
-      ExecutionOption opt;
-      opt.provider = tc.provider;
-      opt.tier_id = tc.tier_id;
-      opt.price_per_call = tc.price_per_call;
-      opt.timeout_ms = tc.default_timeout_ms;
-      opt.max_retries = tc.default_max_retries;
-      n.preference_list.push_back(opt);
-    } else if (n.resource_class == ResourceClass::llm && tc.provider == "llm_provider") {
-      ExecutionOption opt;
-      opt.provider = tc.provider;
-      opt.tier_id = tc.tier_id;
-      opt.price_per_call = tc.price_per_call;
-      opt.timeout_ms = tc.default_timeout_ms;
-      opt.max_retries = tc.default_max_retries;
-      n.preference_list.push_back(opt);
+    ResourceClass rc;
+    if (tc.provider == "embed_provider") {
+      rc = ResourceClass::embed;
+    } else if (tc.provider == "llm_provider") {
+      rc = ResourceClass::llm;
+    } else {
+      continue;
     }
+    ExecutionOption opt;
+    opt.provider_id = tc.provider_id;
+    opt.tier_id = tc.tier_id;
+    opt.price_per_call = tc.price_per_call;
+    opt.timeout_ms = tc.default_timeout_ms;
+    opt.max_retries = tc.default_max_retries;
+    pref_templates_[static_cast<std::size_t>(rc)].push_back(opt);
+  }
+  for (auto& list : pref_templates_) {
+    std::sort(list.begin(), list.end(),
+              [](const ExecutionOption& a, const ExecutionOption& b) {
+                return a.price_per_call < b.price_per_call;
+              });
   }
-  std::sort(n.preference_list.begin(), n.preference_list.end(),
-            [](const ExecutionOption& a, const ExecutionOption& b) {
-              return a.price_per_call < b.price_per_call;
-            });
+}
+
+void Workflow::PopulatePreferenceListForNode(Node& n) {
+  n.preference_list = pref_templates_[static_cast<std::size_t>(n.resource_class)];
 }
 
 void Workflow::OnDecideNext(NodeId decide_node) {
@@ -459,5 +477,117 @@ void Workflow::OnDecideNext(NodeId decide_node) {
   InitializeStateFromDeps(plan_id);
 }
 
+// ----------------------------------------------------------------------------
+// Snapshot support
+// ----------------------------------------------------------------------------
+
+void Workflow::SaveTo(std::ostream& out) const {
+  snap::Write(out, id_);
+  snap::Write(out, params_.pdfs);
+  snap::Write(out, params_.subqueries_per_iter);
+  snap::Write(out, params_.max_iters);
+  snap::Write(out, params_.seed);
+
+  snap::Write(out, done_);
+  snap::Write(out, completed_iters_);
+  snap::Write(out, stop_iter_.has_value());
+  snap::Write(out, stop_iter_.value_or(0));
+  snap::Write(out, change_epoch_);
+
+  snap::Write(out, graph_.next_node_id);
+  snap::Write(out, static_cast<std::uint64_t>(graph_.nodes.size()));
+  for (const Node& n : graph_.nodes) {
+    snap::Write(out, n.id);
+    snap::Write(out, n.workflow_id);
+    snap::Write(out, static_cast<std::uint8_t>(n.type));
+    snap::Write(out, static_cast<std::uint8_t>(n.resource_class));
+    snap::Write(out, n.idempotent);
+    snap::Write(out, static_cast<std::uint8_t>(n.state));
+    snap::Write(out, n.iter);
+    snap::Write(out, n.pdf_idx);
+    snap::Write(out, n.subquery_idx);
+    snap::Write(out, static_cast<std::uint32_t>(n.deps.size()));
+    for (NodeId d : n.deps) snap::Write(out, d);
+    snap::Write(out, static_cast<std::uint32_t>(n.children.size()));
+    for (NodeId c : n.children) snap::Write(out, c);
+    snap::Write(out, n.unmet_deps);
+    snap::Write(out, static_cast<std::uint32_t>(n.preference_list.size()));
+    for (const ExecutionOption& opt : n.preference_list) {
+      snap::Write(out, opt.provider_id);
+      snap::Write(out, opt.tier_id);
+      snap::Write(out, opt.price_per_call);
+      snap::Write(out, opt.timeout_ms);
+      snap::Write(out, opt.max_retries);
+    }
+    snap::Write(out, static_cast<std::uint64_t>(n.output_size_est));
+    snap::Write(out, n.evidence_count_est);
+  }
+}
+
+std::unique_ptr<Workflow> Workflow::LoadFrom(std::istream& in,
+                                             const ProviderConfig* provider_config) {
+  const auto id = snap::Read<WorkflowId>(in);
+  WorkloadParams params;
+  params.pdfs = snap::Read<int>(in);
+  params.subqueries_per_iter = snap::Read<int>(in);
+  params.max_iters = snap::Read<int>(in);
+  params.seed = snap::Read<std::uint64_t>(in);
+
+  auto wf = std::unique_ptr<Workflow>(new Workflow(LoadTag{}, id, params, provider_config));
+  wf->done_ = snap::Read<bool>(in);
+  wf->completed_iters_ = snap::Read<int>(in);
+  const bool has_stop = snap::Read<bool>(in);
+  const int stop = snap::Read<int>(in);
+  if (has_stop) wf->stop_iter_ = stop;
+  wf->change_epoch_ = snap::Read<std::uint64_t>(in);
+
+  wf->graph_.next_node_id = snap::Read<NodeId>(in);
+  const auto node_count = snap::Read<std::uint64_t>(in);
+  for (std::uint64_t i = 0; i < node_count; ++i) {
+    Node n;
+    n.id = snap::Read<NodeId>(in);
+    n.workflow_id = snap::Read<WorkflowId>(in);
+    n.type = static_cast<NodeType>(snap::Read<std::uint8_t>(in));
+    n.resource_class = static_cast<ResourceClass>(snap::Read<std::uint8_t>(in));
+    n.idempotent = snap::Read<bool>(in);
+    n.state = static_cast<NodeState>(snap::Read<std::uint8_t>(in));
+    n.iter = snap::Read<int>(in);
+    n.pdf_idx = snap::Read<int>(in);
+    n.subquery_idx = snap::Read<int>(in);
+    const auto dep_count = snap::Read<std::uint32_t>(in);
+    for (std::uint32_t d = 0; d < dep_count; ++d) n.deps.push_back(snap::Read<NodeId>(in));
+    const auto child_count = snap::Read<std::uint32_t>(in);
+    for (std::uint32_t c = 0; c < child_count; ++c) n.children.push_back(snap::Read<NodeId>(in));
+    n.unmet_deps = snap::Read<int>(in);
+    const auto opt_count = snap::Read<std::uint32_t>(in);
+    for (std::uint32_t o = 0; o < opt_count; ++o) {
+      ExecutionOption opt;
+      opt.provider_id = snap::Read<ProviderId>(in);
+      opt.tier_id = snap::Read<int>(in);
+      opt.price_per_call = snap::Read<double>(in);
+      opt.timeout_ms = snap::Read<int>(in);
+      opt.max_retries = snap::Read<int>(in);
+      n.preference_list.push_back(std::move(opt));
+    }
+    n.output_size_est = static_cast<std::size_t>(snap::Read<std::uint64_t>(in));
+    n.evidence_count_est = snap::Read<int>(in);
+
+    // Attempts that were queued or running when the snapshot was written no
+    // longer exist; make their nodes runnable again for re-dispatch.
+    if (n.state == NodeState::Queued || n.state == NodeState::Running) {
+      n.state = NodeState::Runnable;
+    }
+    if (n.state == NodeState::Runnable) wf->runnable_set_.insert(n.id);
+    // An Aggregate node is created exactly once per expanded iteration, so
+    // its presence reconstructs the expansion flags.
+    if (n.type == NodeType::Aggregate && n.iter >= 0 &&
+        n.iter < static_cast<int>(wf->expanded_iters_.size())) {
+      wf->expanded_iters_[static_cast<std::size_t>(n.iter)] = true;
+    }
+    wf->graph_.nodes.push_back(std::move(n));
+  }
+  return wf;
+}
+
 }  // namespace sim
 
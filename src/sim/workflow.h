@@ -3,9 +3,13 @@
 #include "sim/config.h"
 #include "sim/types.h"
 
+#include <array>
 #include <cstdint>
+#include <deque>
+#include <iosfwd>
+#include <memory>
 #include <optional>
-#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace sim {
@@ -26,8 +30,8 @@ class Workflow {
   WorkflowId id() const { return id_; }
   const WorkloadParams& params() const { return params_; }
 
-  const std::unordered_map<NodeId, Node>& nodes() const { return graph_.nodes; }
-  std::unordered_map<NodeId, Node>& nodes_mut() { return graph_.nodes; }
+  const std::deque<Node>& nodes() const { return graph_.nodes; }
+  std::deque<Node>& nodes_mut() { return graph_.nodes; }
 
   const Node& node(NodeId nid) const;
   Node& node_mut(NodeId nid);
@@ -36,10 +40,19 @@ class Workflow {
   int completed_iters() const { return completed_iters_; }
   std::optional<int> stop_iter() const { return stop_iter_; }
 
-  // Returns nodes that became runnable due to dependency satisfaction.
-  std::vector<NodeId> RefreshRunnable();
+  // Monotonic counter bumped whenever the graph grows or a node reaches a
+  // terminal state. Lets callers cache per-graph derived data (e.g. remaining
+  // critical path) and invalidate only when the DAG actually changed.
+  std::uint64_t change_epoch() const { return change_epoch_; }
+
+  // Snapshot of the maintained ready-set, sorted for deterministic iteration.
+  // The set itself is updated incrementally via per-node unsatisfied-dependency
+  // counters, so no full-graph scan happens here or on state transitions.
   std::vector<NodeId> RunnableNodes() const;
 
+  // Number of nodes currently Queued or Running, maintained incrementally.
+  int in_flight_count() const { return in_flight_count_; }
+
   // State machine transitions used by a controller/scheduler.
   void MarkQueued(NodeId nid);
   void MarkRunning(NodeId nid);
@@ -51,10 +64,25 @@ class Workflow {
   // Best-effort pruning hook: cancels all non-terminal nodes in branches that are no longer needed.
   void PruneAfterStop(int stop_iter);
 
+  // Snapshot support: SaveTo writes the full graph and iteration state;
+  // LoadFrom reconstructs a mid-run workflow. Queued/Running nodes are
+  // restored as Runnable, so attempts that were in flight when the snapshot
+  // was taken are simply re-dispatched after resume.
+  void SaveTo(std::ostream& out) const;
+  static std::unique_ptr<Workflow> LoadFrom(std::istream& in,
+                                            const ProviderConfig* provider_config);
+
  private:
+  struct LoadTag {};
+  Workflow(LoadTag, WorkflowId id, WorkloadParams params, const ProviderConfig* provider_config)
+      : id_(id), params_(params), provider_config_(provider_config) {
+    expanded_iters_.resize(static_cast<std::size_t>(params_.max_iters), false);
+    BuildPreferenceTemplates();
+  }
+
   NodeId NewNodeId();
   Node& AddNode(Node n);
-  void AddEdge(NodeId from, NodeId to);  // from -> to
+  void AddEdge(NodeId from, NodeId to);  // from -> to; maintains unmet_deps
 
   void SetState(NodeId nid, NodeState next);
   bool DepsSatisfied(const Node& n) const;
@@ -64,6 +92,7 @@ class Workflow {
   void ExpandIterationFromPlan(NodeId plan_node);
   void OnDecideNext(NodeId decide_node);
   DecideAction ComputeDecideAction(int iter) const;
+  void BuildPreferenceTemplates();
   void PopulatePreferenceListForNode(Node& n);
 
   int IterEvidenceTotal(int iter) const;
@@ -73,10 +102,22 @@ class Workflow {
   WorkloadParams params_;
   const ProviderConfig* provider_config_ = nullptr;
   WorkflowGraph graph_;
+  std::unordered_set<NodeId> runnable_set_;
+  int in_flight_count_ = 0;
+
+  // One flag per iteration replaces the former full-graph scan guarding
+  // against double expansion.
+  std::vector<bool> expanded_iters_;
+  // Preference lists depend only on the resource class, so one sorted
+  // template per class is built at construction and copied into each node,
+  // instead of re-scanning and re-sorting the provider config per node while
+  // the owning shard's lock is held.
+  std::array<std::vector<ExecutionOption>, kNumResourceClasses> pref_templates_;
 
   bool done_ = false;
   int completed_iters_ = 0;
   std::optional<int> stop_iter_;
+  std::uint64_t change_epoch_ = 0;
 };
 
 }  // namespace sim